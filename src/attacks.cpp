@@ -2,14 +2,20 @@
 #include "bitboard.h"
 #include "board.h"
 #include "masks.h"
+#include "move.h"
 #include "types.h"
 
+// Shared by every copy of the hot code, so only the default copy defines it
+#if !KF_ISA_COPY
 uint64_t pawnAttacks[SQUARE_NUM][2];
 uint64_t knightAttacks[SQUARE_NUM];
 uint64_t bishopAttacks[SQUARE_NUM][4];
 uint64_t rookAttacks[SQUARE_NUM][4];
 uint64_t queenAttacks[SQUARE_NUM][8];
 uint64_t kingAttacks[SQUARE_NUM];
+#endif
+
+inline namespace KF_ISA {
 
 static void initPawnAttacks(const uint64_t& bb, int sqr) {
 	if (bb & ~fileHMask) {
@@ -154,6 +160,9 @@ uint64_t getQueenAttacks(const Board& b, const uint64_t& valid, int color, int s
 }
 
 bool squareIsAttacked(const Board& b, int color, int sqr) {
+#if KF_ATTACK_MAPS
+	return checkBit(b.attacks[!color], sqr);
+#endif
 	const uint64_t enemy = b.colors[!color];
 	const uint64_t occ = ~b.colors[NO_COLOR];
 	return (pawnAttacks[sqr][color] & enemy & b.pieces[PAWN])
@@ -180,6 +189,114 @@ int smallestAttacker(const Board&b, const uint64_t& attackers) {
 }
 
 bool inCheck(const Board& b, int color) {
-	int kingsqr = lsb(b.pieces[KING] & b.colors[color]);
-	return squareIsAttacked(b, color, kingsqr);
+#if KF_ATTACK_MAPS
+	return b.attacks[!color] & b.pieces[KING] & b.colors[color];
+#endif
+	return squareIsAttacked(b, color, b.kingSquares[color]);
+}
+
+uint64_t pieceAttacks(int piece, int sqr, const uint64_t& occupied) {
+	switch (pieceType(piece)) {
+	case PAWN:
+		return pawnAttacks[sqr][pieceColor(piece)];
+	case KNIGHT:
+		return knightAttacks[sqr];
+	case BISHOP:
+		return getBishopMagic(occupied, sqr);
+	case ROOK:
+		return getRookMagic(occupied, sqr);
+	case QUEEN:
+		return getBishopMagic(occupied, sqr) | getRookMagic(occupied, sqr);
+	default:
+		return kingAttacks[sqr];
+	}
+}
+
+#if KF_ATTACK_MAPS
+void refreshAttackMaps(Board& b) {
+	memset(b.attackCounts, 0, sizeof(b.attackCounts));
+	b.attacks[WHITE] = b.attacks[BLACK] = 0;
+
+	const uint64_t occupied = ~b.colors[NO_COLOR];
+	uint64_t pieces = occupied;
+	while (pieces) {
+		const int sqr = popBit(pieces);
+		const int color = pieceColor(b.squares[sqr]);
+		uint64_t attacks = pieceAttacks(b.squares[sqr], sqr, occupied);
+		b.attacks[color] |= attacks;
+		while (attacks) b.attackCounts[color][popBit(attacks)]++;
+	}
+}
+
+void beginAttackUpdate(const Board& b, const uint16_t& m, int mover, AttackUpdate& update) {
+	update.occupied = ~b.colors[NO_COLOR];
+	update.changed = 0;
+	update.count = 0;
+
+	auto add = [&b, &update](int sqr) {
+		update.squares[update.count] = sqr;
+		update.pieces[update.count] = b.squares[sqr];
+		update.changed |= 1ull << sqr;
+		update.count++;
+	};
+
+	add(moveFrom(m));
+	add(moveTo(m));
+	if (moveFlag(m) == EP_MOVE) {
+		add(moveTo(m) + ((mover == WHITE) ? S : N));
+	}
+	else if (moveFlag(m) == CASTLE_MOVE) {
+		const bool kingSide = (moveTo(m) == G1 || moveTo(m) == G8);
+		add(moveFrom(m) + (kingSide ? 3 : -4));
+		add(moveFrom(m) + (kingSide ? 1 : -1));
+	}
+}
+
+void finishAttackUpdate(Board& b, const AttackUpdate& update) {
+	const uint64_t before = update.occupied;
+	const uint64_t after = ~b.colors[NO_COLOR];
+	uint64_t touched[2] = { 0, 0 };
+
+	auto apply = [&b, &touched](int piece, int sqr, const uint64_t& occupied, int delta) {
+		const int color = pieceColor(piece);
+		uint64_t attacks = pieceAttacks(piece, sqr, occupied);
+		touched[color] |= attacks;
+		while (attacks) b.attackCounts[color][popBit(attacks)] += delta;
+	};
+
+	// Step 1: Pieces that left, arrived on or were captured on the changed squares
+	for (int i = 0; i < update.count; ++i) {
+		const int sqr = update.squares[i];
+		if (update.pieces[i] != EMPTY) apply(update.pieces[i], sqr, before, -1);
+		if (b.squares[sqr] != EMPTY) apply(b.squares[sqr], sqr, after, 1);
+	}
+
+	// Step 2: Sliders elsewhere only change if one of their rays reaches a changed square, before or after the move
+	uint64_t sliders = 0;
+	uint64_t changed = update.changed;
+	while (changed) {
+		const int sqr = popBit(changed);
+		sliders |= (getBishopMagic(before, sqr) | getBishopMagic(after, sqr)) & (b.pieces[BISHOP] | b.pieces[QUEEN]);
+		sliders |= (getRookMagic(before, sqr) | getRookMagic(after, sqr)) & (b.pieces[ROOK] | b.pieces[QUEEN]);
+	}
+	sliders &= ~update.changed;
+	while (sliders) {
+		const int sqr = popBit(sliders);
+		apply(b.squares[sqr], sqr, before, -1);
+		apply(b.squares[sqr], sqr, after, 1);
+	}
+
+	// Step 3: Only the squares whose counts changed can change in the maps
+	for (int color = WHITE; color <= BLACK; ++color) {
+		uint64_t attacked = 0;
+		uint64_t squares = touched[color];
+		while (squares) {
+			const int sqr = popBit(squares);
+			if (b.attackCounts[color][sqr]) attacked |= 1ull << sqr;
+		}
+		b.attacks[color] = (b.attacks[color] & ~touched[color]) | attacked;
+	}
+}
+#endif
+
 }
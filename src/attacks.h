@@ -1,6 +1,7 @@
 #ifndef ATTACKS_H
 #define ATTACKS_H
 
+#include "cpu.h"
 #include "types.h"
 
 static constexpr int bishopDirs[4] = { NE, NW, SE, SW };
@@ -14,6 +15,8 @@ extern uint64_t rookAttacks[SQUARE_NUM][4];
 extern uint64_t queenAttacks[SQUARE_NUM][8];
 extern uint64_t kingAttacks[SQUARE_NUM];
 
+inline namespace KF_ISA {
+
 static void initPawnAttacks(const uint64_t& bb, int sqr);
 static void initKnightAttacks(const uint64_t& bb, int sqr);
 static void initBishopAttacks(int sqr);
@@ -36,4 +39,27 @@ int smallestAttacker(const Board& b, const uint64_t& attackers);
 
 bool inCheck(const Board& b, int color);
 
+uint64_t pieceAttacks(int piece, int sqr, const uint64_t& occupied);
+
+}
+
+#if KF_ATTACK_MAPS
+// The squares a move changes and what was on them, recorded before the move is made or undone
+struct AttackUpdate {
+	uint64_t occupied;
+	uint64_t changed;
+	int count;
+	int squares[4];
+	int pieces[4];
+};
+
+inline namespace KF_ISA {
+
+void refreshAttackMaps(Board& b);
+void beginAttackUpdate(const Board& b, const uint16_t& m, int mover, AttackUpdate& update);
+void finishAttackUpdate(Board& b, const AttackUpdate& update);
+
+}
+#endif
+
 #endif
\ No newline at end of file
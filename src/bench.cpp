@@ -0,0 +1,268 @@
+#include <chrono>
+
+#include "bench.h"
+#include "board.h"
+#include "pawns.h"
+#include "search.h"
+#include "tt.h"
+#include "types.h"
+
+#if defined(__linux__)
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#define KF_PIPES 1
+#else
+#define KF_PIPES 0
+#endif
+
+typedef std::chrono::steady_clock Clock;
+
+static int64_t microsecondsSince(Clock::time_point start) {
+	return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+}
+
+void LatencyStats::print(std::string_view name) {
+	if (samples.empty()) return;
+	std::sort(samples.begin(), samples.end());
+	const size_t n = samples.size();
+	std::cout << name << ": count " << n;
+	std::cout << " p50 " << samples[n / 2] << " us";
+	std::cout << " p99 " << samples[std::min(n * 99 / 100, n - 1)] << " us";
+	std::cout << " max " << samples[n - 1] << " us\n";
+}
+
+void bench(int depth) {
+	Board b;
+	SearchInfo si;
+	uint64_t nodes = 0;
+
+	auto start = Clock::now();
+	for (const auto& fen : benchPositions) {
+		// Every run starts from empty tables so that node counts can be compared between builds
+		clearTT();
+		clearPawnHash(si.thread.evalTables.pawns);
+		parseFen(b, fen);
+		si.history.reset(b.key);
+		si.limits.clear();
+		si.limits.depth = depth;
+		si.stop = false;
+		si.pondering = false;
+		si.tm.init(TimeLimits());
+
+		entryPoints->iterativeDeepening(b, si);
+		nodes += si.searchedNodes();
+	}
+	int64_t elapsed = std::max<int64_t>(microsecondsSince(start), 1);
+
+	std::cout << "Nodes: " << nodes << "\n";
+	std::cout << "Time: " << elapsed / 1000 << "\n";
+	std::cout << "NPS: " << nodes * 1000000 / elapsed << "\n";
+	std::cout << "Mode: " << (KF_COPY_MAKE ? "copy-make" : "make/unmake") << "\n";
+}
+
+void timeBench() {
+	Board b;
+	SearchInfo si;
+
+	clearTT();
+	clearPawnHash(si.thread.evalTables.pawns);
+	parseFen(b, startFen);
+	si.history.reset(b.key);
+	si.limits.clear();
+	si.stop = false;
+	si.pondering = false;
+	si.tm.init(timeBenchLimits);
+
+	entryPoints->iterativeDeepening(b, si);
+	int64_t elapsed = si.tm.elapsed();
+
+	std::cout << "Optimum: " << si.tm.optimum << "\n";
+	std::cout << "Hard limit: " << si.tm.hardLimit << "\n";
+	std::cout << "Time: " << elapsed << "\n";
+	std::cout << "Result: " << ((elapsed <= si.tm.optimum * timeBenchTolerance) ? "ok" : "too slow") << "\n";
+}
+
+void pawnBench(int iterations) {
+	static constexpr int positionCount = sizeof(benchPositions) / sizeof(benchPositions[0]);
+	Board boards[positionCount];
+	for (int i = 0; i < positionCount; ++i) parseFen(boards[i], benchPositions[i]);
+
+	// The checksum keeps the compiler from dropping the work
+	PawnEntry pe;
+	int64_t checksum = 0;
+	auto start = Clock::now();
+	for (int i = 0; i < iterations; ++i) {
+		const Board& b = boards[i % positionCount];
+		computePawns(b, pe);
+		checksum += mgScore(pe.score[WHITE]) - egScore(pe.score[BLACK]) + (int)(pe.passed[WHITE] ^ pe.passed[BLACK]);
+	}
+	int64_t elapsed = std::max<int64_t>(microsecondsSince(start), 1);
+
+	std::cout << "Evaluations: " << iterations << "\n";
+	std::cout << "Time: " << elapsed / 1000 << "\n";
+	std::cout << "ns/evaluation: " << (double)elapsed * 1000 / std::max(iterations, 1) << "\n";
+	std::cout << "Checksum: " << checksum << "\n";
+}
+
+#if KF_PIPES
+
+// The child end of the pipes, read line by line without allocating per line
+struct EnginePipe {
+	pid_t pid = -1;
+	int in = -1;  // We write commands here
+	int out = -1;  // and read the replies from here
+	char buffer[1 << 16];
+	size_t start = 0;
+	size_t end = 0;
+
+	bool spawn() {
+		int toChild[2];
+		int fromChild[2];
+		if (pipe(toChild) != 0) return false;
+		if (pipe(fromChild) != 0) {
+			close(toChild[0]);
+			close(toChild[1]);
+			return false;
+		}
+
+		pid = fork();
+		if (pid < 0) return false;
+		if (pid == 0) {
+			dup2(toChild[0], STDIN_FILENO);
+			dup2(fromChild[1], STDOUT_FILENO);
+			close(toChild[0]);
+			close(toChild[1]);
+			close(fromChild[0]);
+			close(fromChild[1]);
+			execl("/proc/self/exe", "kingfisher", (char*)nullptr);
+			_exit(1);
+		}
+
+		close(toChild[0]);
+		close(fromChild[1]);
+		in = toChild[1];
+		out = fromChild[0];
+		return true;
+	}
+
+	bool send(std::string_view command) {
+		while (!command.empty()) {
+			ssize_t n = write(in, command.data(), command.size());
+			if (n <= 0) return false;
+			command.remove_prefix(n);
+		}
+		return true;
+	}
+
+	// Reads lines until one starts with the given prefix, which is returned without the line break
+	bool waitFor(std::string_view prefix, std::string_view& line) {
+		while (1) {
+			char* newline = static_cast<char*>(memchr(buffer + start, '\n', end - start));
+			if (newline) {
+				line = std::string_view(buffer + start, newline - (buffer + start));
+				start = newline - buffer + 1;
+				if (line.substr(0, prefix.size()) == prefix) return true;
+				continue;
+			}
+
+			// Move the partial line to the front and read more
+			memmove(buffer, buffer + start, end - start);
+			end -= start;
+			start = 0;
+			if (end == sizeof(buffer)) return false;
+			ssize_t n = read(out, buffer + end, sizeof(buffer) - end);
+			if (n <= 0) return false;
+			end += n;
+		}
+	}
+
+	void quit() {
+		if (pid < 0) return;
+		send("quit\n");
+		close(in);
+		close(out);
+		waitpid(pid, nullptr, 0);
+		pid = -1;
+	}
+};
+
+void latencyBench(int searches, int moveTime) {
+	// A child that dies early must not kill us on the next write
+	signal(SIGPIPE, SIG_IGN);
+
+	LatencyStats startup, isready, position, go;
+	EnginePipe engine;
+	std::string_view line;
+
+	auto start = Clock::now();
+	if (!engine.spawn()) {
+		std::cout << "info string Could not start engine\n";
+		return;
+	}
+	if (!engine.send("uci\n") || !engine.waitFor("uciok", line)) {
+		std::cout << "info string Engine did not answer uci\n";
+		engine.quit();
+		return;
+	}
+	startup.add(microsecondsSince(start));
+
+	// The engine plays against itself, so position commands grow move by move like in a real game
+	std::string moves;
+	std::string command;
+	const std::string goCommand = "go movetime " + std::to_string(moveTime) + "\n";
+	int ply = 0;
+	bool ok = true;
+
+	auto benchStart = Clock::now();
+	for (int i = 0; i < searches && ok; ++i) {
+		if (ply == 0) {
+			moves.clear();
+			ok &= engine.send("ucinewgame\n");
+		}
+
+		// Step 1: isready on its own
+		start = Clock::now();
+		ok &= engine.send("isready\n") && engine.waitFor("readyok", line);
+		isready.add(microsecondsSince(start));
+
+		// Step 2: position update, which has no reply, so we measure it together with an isready
+		command = "position startpos";
+		if (!moves.empty()) command += " moves" + moves;
+		command += "\nisready\n";
+		start = Clock::now();
+		ok &= engine.send(command) && engine.waitFor("readyok", line);
+		position.add(microsecondsSince(start));
+
+		// Step 3: a short search
+		start = Clock::now();
+		ok &= engine.send(goCommand) && engine.waitFor("bestmove", line);
+		go.add(microsecondsSince(start));
+		if (!ok) break;
+
+		std::string_view bestMove = line.substr(9, line.find(' ', 9) - 9);
+		if (bestMove == "0000" || bestMove.empty() || ++ply >= latencyBenchGameLength) {
+			ply = 0;
+			continue;
+		}
+		moves += ' ';
+		moves += bestMove;
+	}
+	int64_t total = microsecondsSince(benchStart);
+	engine.quit();
+
+	if (!ok) std::cout << "info string Engine stopped answering\n";
+	startup.print("startup to uciok");
+	isready.print("isready to readyok");
+	position.print("position and isready to readyok");
+	go.print("go movetime " + std::to_string(moveTime) + " to bestmove");
+	std::cout << "Time: " << total / 1000 << "\n";
+}
+
+#else
+
+void latencyBench(int searches, int moveTime) {
+	std::cout << "info string latencybench is only supported on Linux\n";
+}
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "timeman.h"
+#include "types.h"
+
+static constexpr int benchDepth = 10;
+
+// A mix of openings, middlegames and endgames, searched to a fixed depth to compare builds
+static constexpr std::string_view benchPositions[] = {
+	"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+	"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+	"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+	"r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+	"rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+	"r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+	"r1bq1rk1/pp2ppbp/2np1np1/8/3NP3/2N1BP2/PPPQ2PP/R3KB1R w KQ - 3 9",
+	"2r3k1/pp3ppp/4p3/3pP3/3P4/P4N2/1P3PPP/2R3K1 w - - 0 24",
+	"6k1/5pp1/7p/8/8/6PP/5PK1/3r4 b - - 0 40",
+	"8/8/4k3/3p4/3P4/4K3/8/8 w - - 0 60",
+};
+
+static constexpr int pawnBenchIterations = 1000000;
+
+// The first move of a one minute game with a one second increment, which should take about the optimum time
+static constexpr TimeLimits timeBenchLimits = { true, 60000, 1000, -1, -1 };
+static constexpr double timeBenchTolerance = 1.5;  // Times the optimum a move may take before the check fails
+
+static constexpr int latencyBenchSearches = 1000;
+static constexpr int latencyBenchMoveTime = 10;
+static constexpr int latencyBenchGameLength = 120;  // Plies before a new game is started
+
+// Summary of a set of round trip times in microseconds
+struct LatencyStats {
+	std::vector<int64_t> samples;
+
+	void add(int64_t us) { samples.push_back(us); }
+	void print(std::string_view name);
+};
+
+// Searches every bench position to a fixed depth and reports the total node count and speed
+void bench(int depth);
+
+// Plays the first move of a timed game and checks the time used against the optimum
+void timeBench();
+
+// Times the pawn structure evaluation alone, without the pawn hash table
+void pawnBench(int iterations);
+
+// Starts a second copy of the engine and drives it over its stdin and stdout like a GUI would
+void latencyBench(int searches, int moveTime);
+
+#endif
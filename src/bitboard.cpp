@@ -1,33 +1,17 @@
 #include "bitboard.h"
 #include "types.h"
 
-int countBits(const uint64_t& b) {
-	return __builtin_popcountll(b);
-}
+inline namespace KF_ISA {
 
 bool checkBit(const uint64_t& b, int sqr) {
 	assert(validSquare(sqr));
 	return (b & (1ull << sqr)) > 0;
 }
 
-int lsb(const uint64_t& b) {
-	return __builtin_ctzll(b);
-}
-
-int msb(const uint64_t& b) {
-	return __builtin_clzll(b) ^ 63;
-}
-
 int generalBitscan(const uint64_t& b, const int dir) {
 	return (dir >= 0) ? lsb(b) : msb(b);
 }
 
-int popBit(uint64_t& b) {
-	int index = lsb(b);
-	b &= b - 1;
-	return index;
-}
-
 void setBit(uint64_t& b, int sqr) {
 	assert(!checkBit(b, sqr));
 	b ^= (1ull << sqr);
@@ -51,4 +35,6 @@ void printBitboard(const uint64_t& b) {
 		std::cout << l << "\n";
 	}
 	std::cout << "\n" << "Population count: " << countBits(b) << "\n\n";
+}
+
 }
\ No newline at end of file
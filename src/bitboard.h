@@ -1,6 +1,7 @@
 #ifndef BITBOARD_H
 #define BITBOARD_H
 
+#include "cpu.h"
 #include "types.h"
 
 static constexpr uint64_t rank1Mask = 0x00000000000000FFull;
@@ -34,16 +35,68 @@ static constexpr uint64_t middleFileMask = (fileCMask | fileDMask | fileEMask |
 static constexpr uint64_t centerMasks[2] = { middleFileMask & (rank2Mask | rank3Mask | rank4Mask),
                                              middleFileMask & (rank5Mask | rank6Mask | rank7Mask) };
 
-int countBits(const uint64_t& b);
+// Set-wise fills, every square north or south of a set bit is set as well
+static inline uint64_t northFill(uint64_t b) {
+	b |= b << 8;
+	b |= b << 16;
+	b |= b << 32;
+	return b;
+}
+
+static inline uint64_t southFill(uint64_t b) {
+	b |= b >> 8;
+	b |= b >> 16;
+	b |= b >> 32;
+	return b;
+}
+
+static inline uint64_t fileFill(uint64_t b) {
+	return northFill(b) | southFill(b);
+}
+
+// Fills towards the promotion rank of the given color
+static inline uint64_t frontFill(uint64_t b, int color) {
+	return (color == WHITE) ? northFill(b) : southFill(b);
+}
+
+static inline uint64_t pawnPush(uint64_t pawns, int color) {
+	return (color == WHITE) ? pawns << 8 : pawns >> 8;
+}
+
+static inline uint64_t pawnAttackSet(uint64_t pawns, int color) {
+	return (color == WHITE) ? (((pawns << 7) & ~fileHMask) | ((pawns << 9) & ~fileAMask)) :
+							  (((pawns >> 7) & ~fileAMask) | ((pawns >> 9) & ~fileHMask));
+}
+
+// The hot helpers are inlined into their callers, so they use popcnt and tzcnt whenever the build targets a CPU that has them
+static inline int countBits(const uint64_t& b) {
+	return __builtin_popcountll(b);
+}
+
+static inline int lsb(const uint64_t& b) {
+	return __builtin_ctzll(b);
+}
+
+static inline int msb(const uint64_t& b) {
+	return __builtin_clzll(b) ^ 63;
+}
+
+static inline int popBit(uint64_t& b) {
+	int index = __builtin_ctzll(b);
+	b &= b - 1;
+	return index;
+}
+
+inline namespace KF_ISA {
+
 bool checkBit(const uint64_t& b, int sqr);
-int lsb(const uint64_t& b);
-int msb(const uint64_t& b);
 int generalBitscan(const uint64_t& b, const int dir);
-int popBit(uint64_t& b);
 void setBit(uint64_t& b, int sqr);
 void setBitIfValid(uint64_t& b, int sqr);
 void clearBit(uint64_t& b, int sqr);
 
 void printBitboard(const uint64_t& b);
 
+}
+
 #endif
\ No newline at end of file
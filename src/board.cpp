@@ -2,19 +2,29 @@
 #include "bitboard.h"
 #include "board.h"
 #include "evaluate.h"
+#include "masks.h"
+#include "material.h"
 #include "move.h"
 #include "movegen.h"
 #include "tt.h"
 #include "types.h"
 
+// Shared by every copy of the hot code, so only the default copy defines it
+#if !KF_ISA_COPY
 uint64_t pieceKeys[12][SQUARE_NUM];
 uint64_t castlingKeys[16];
 uint64_t epKeys[8];
 uint64_t turnKey;
 
+uint64_t cuckooKeys[cuckooSize];
+uint16_t cuckooMoves[cuckooSize];
+#endif
+
+inline namespace KF_ISA {
+
 static uint64_t rand64() {
-	std::random_device rd;
-	std::mt19937_64 gen(rd());
+	// A fixed seed gives the same keys on every run, so searches and bench node counts are reproducible
+	static std::mt19937_64 gen(0x4b696e67666973ull);
 	std::uniform_int_distribution<long long int> dist(std::llround(std::pow(2, 61)), std::llround(std::pow(2, 62)));
 	return dist(gen);
 }
@@ -34,6 +44,33 @@ void initKeys() {
 	turnKey = rand64();
 }
 
+void initCuckoo() {
+	// Needs the keys and the attack tables
+	memset(cuckooKeys, 0, sizeof(cuckooKeys));
+	memset(cuckooMoves, 0, sizeof(cuckooMoves));
+
+	for (int piece = W_PAWN; piece <= B_KING; ++piece) {
+		if (pieceType(piece) == PAWN) continue;
+		for (int from = 0; from < SQUARE_NUM; ++from) {
+			for (int to = from + 1; to < SQUARE_NUM; ++to) {
+				if (!checkBit(pieceAttacks(piece, from, 0), to)) continue;
+
+				// A move and its reverse change the key the same way, so only one of them is stored
+				uint64_t key = pieceKeys[piece][from] ^ pieceKeys[piece][to] ^ turnKey;
+				uint16_t m = createMove(from, to, NORMAL_MOVE);
+				int i = cuckooHash1(key);
+				while (1) {
+					std::swap(cuckooKeys[i], key);
+					std::swap(cuckooMoves[i], m);
+					if (!m) break;
+					// Push the old entry to its other slot
+					i = (i == cuckooHash1(key)) ? cuckooHash2(key) : cuckooHash1(key);
+				}
+			}
+		}
+	}
+}
+
 void clearBoard(Board& b) {
 	memset(&b, 0, sizeof(b));
 	for (auto& i : b.squares) i = EMPTY;
@@ -43,100 +80,202 @@ void clearBoard(Board& b) {
 
 void setSquare(Board& b, int piece, int sqr) {
 	assert(validSquare(sqr));
+	assert(piece >= W_PAWN && piece <= B_KING);
 	b.squares[sqr] = piece;
 	b.key ^= pieceKeys[piece][sqr];
+	b.materialKey += materialKeyIncrements[piece];
+	if (pieceType(piece) == PAWN) b.pawnKey ^= pieceKeys[piece][sqr];
 
 	setBit(b.colors[pieceColor(piece)], sqr);
 	setBit(b.pieces[pieceType(piece)], sqr);
 	clearBit(b.colors[NO_COLOR], sqr);
+
+	b.psqt += pieceSquareTable[piece][sqr];
+	b.phase += pieceMaterial.phase[piece];
+	b.nonPawnMaterial[pieceColor(piece)] += pieceMaterial.nonPawn[piece];
+
+	addPiece(b, piece, sqr);
+	if (pieceType(piece) == KING) b.kingSquares[pieceColor(piece)] = sqr;
 }
 
-bool drawnByRepetition(const Board& b) {
+bool drawnByRepetition(const Board& b, const KeyHistory& history) {
+	// The last key belongs to the current position
+	// Positions before the last capture, pawn move or null move cannot come back, so the scan stops there
+	const int last = (int)history.keys.size() - 1;
+	const int end = std::max(last - b.fiftyMove, 0);
 	int count = 0;
-	for (int i = b.moveNum - 2; i >= 0; i -= 2) {
-		if (b.history[i] == b.key && (++count == 2)) return true;
+	for (int i = last - 4; i >= end; i -= 2) {
+		if (history.keys[i] == b.key && (++count == 2)) return true;
 	}
 	return false;
 }
 
-void parseFen(Board& b, std::string fen) {
-	if (fen.empty()) return;
-	clearBoard(b);
+bool insufficientMaterial(const Board& b) {
+	if (b.pieces[PAWN] | b.pieces[ROOK] | b.pieces[QUEEN]) return false;
 
-	int sqr = A8;
-	int pos = 0;
+	// A single minor piece cannot mate, and neither can any number of bishops that all stand on squares of one color
+	const uint64_t minors = b.pieces[KNIGHT] | b.pieces[BISHOP];
+	if (!(minors & (minors - 1))) return true;
+	return !b.pieces[KNIGHT] && (!(b.pieces[BISHOP] & squareColorMasks[0]) || !(b.pieces[BISHOP] & squareColorMasks[1]));
+}
 
-	// Pieces and squares
-	for (int i = 0, size = fen.size(); i < size; ++i) {
-		auto chr = fen[i];
-		if (chr == ' ') {
-			pos = i + 1;
-			break;
+static bool hasLegalMove(const Board& b) {
+	for (const uint16_t m : genAllMoves(b)) {
+		Board child = b;
+		makeMove(child, m);
+		if (!inCheck(child, !child.turn)) return true;
+	}
+	return false;
+}
+
+bool isDraw(const Board& b, const KeyHistory& history) {
+	// Step 1: Fifty move rule, unless the last move gave mate
+	if (b.fiftyMove >= 100 && (!inCheck(b, b.turn) || hasLegalMove(b))) return true;
+
+	// Step 2: Threefold repetition
+	if (drawnByRepetition(b, history)) return true;
+
+	// Step 3: Neither side has enough material to mate
+	return insufficientMaterial(b);
+}
+
+bool hasUpcomingRepetition(const Board& b, const KeyHistory& history, int ply) {
+	// The side to move can repeat a position if a single reversible move turns the current key into an earlier one
+	// Only positions inside the search count, as a repetition of a game position is not yet a draw
+	const int last = (int)history.keys.size() - 1;
+	const int end = std::min(b.fiftyMove, last);
+	if (end < 3) return false;
+
+	const uint64_t occupied = ~b.colors[NO_COLOR];
+	for (int i = 3; i <= end && i < ply; i += 2) {
+		const uint64_t moveKey = b.key ^ history.keys[last - i];
+		int index = cuckooHash1(moveKey);
+		if (cuckooKeys[index] != moveKey) {
+			index = cuckooHash2(moveKey);
+			if (cuckooKeys[index] != moveKey) continue;
 		}
-		if (isdigit(chr)) {
-			sqr += chr - '0';
+
+		// The move is only possible if nothing stands between its squares
+		const int from = moveFrom(cuckooMoves[index]);
+		const int to = moveTo(cuckooMoves[index]);
+		if (checkBit(knightAttacks[from] | getBishopMagic(occupied, from) | getRookMagic(occupied, from), to)) return true;
+	}
+	return false;
+}
+
+static inline void skipSpaces(std::string_view& s) {
+	while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+}
+
+static inline std::string_view nextField(std::string_view& s) {
+	skipSpaces(s);
+	size_t end = 0;
+	while (end < s.size() && s[end] != ' ' && s[end] != '\t' && s[end] != '\r' && s[end] != '\n') end++;
+	std::string_view field = s.substr(0, end);
+	s.remove_prefix(end);
+	return field;
+}
+
+bool parseCounter(std::string_view field, int& value) {
+	int result;
+	const char* last = field.data() + field.size();
+	auto [end, ec] = std::from_chars(field.data(), last, result);
+	if (field.empty() || ec != std::errc() || end != last || result < 0 || result > maxFenCounter) return false;
+	value = result;
+	return true;
+}
+
+bool parseFenFields(Board& b, std::string_view& fen) {
+	clearBoard(b);
+
+	// Step 1: Piece placement, from rank 8 down to rank 1
+	std::string_view placement = nextField(fen);
+	int rank = 7;
+	int file = 0;
+	for (char chr : placement) {
+		if (chr >= '1' && chr <= '8') {
+			file += chr - '0';
+			if (file > 8) return false;
 		}
 		else if (chr == '/') {
-			sqr -= 16;
+			if (file != 8 || rank == 0) return false;
+			rank--;
+			file = 0;
 		}
 		else {
-			for (int j = 0; j < 12; ++j) {
-				if (pieceChars[j] == chr) {
-					setSquare(b, j, sqr);
-					int color = pieceColor(j);
-					int type = pieceType(j);
-					int mgScore = psqtScore(type, psqtSquare(sqr, color), MG);
-					b.psqt[MG] += (color == WHITE) ? mgScore : -mgScore;
-
-					int egScore = psqtScore(type, psqtSquare(sqr, color), EG);
-					b.psqt[EG] += (color == WHITE) ? egScore : -egScore;
-					sqr++;
-					break;
-				}
-			}
+			const int piece = pieceFromChar[(unsigned char)chr];
+			if (piece == EMPTY || file > 7 || materialCount(b.materialKey, piece) == maxPieceCount) return false;
+			setSquare(b, piece, toSquare(rank, file));
+			file++;
 		}
 	}
+	if (rank != 0 || file != 8) return false;
+
+	// Exactly one king per side, and no pawns on the back ranks
+	if (countBits(b.pieces[KING] & b.colors[WHITE]) != 1 || countBits(b.pieces[KING] & b.colors[BLACK]) != 1) return false;
+	if (b.pieces[PAWN] & (rank1Mask | rank8Mask)) return false;
+
+	// Every piece beyond the starting set needs a promoted pawn, which also keeps later promotions within the piece lists
+	for (int color = WHITE; color <= BLACK; ++color) {
+		int promoted = std::max(materialCount(b.materialKey, makePiece(QUEEN, color)) - 1, 0);
+		for (int type = KNIGHT; type <= ROOK; ++type) promoted += std::max(materialCount(b.materialKey, makePiece(type, color)) - 2, 0);
+		if (materialCount(b.materialKey, makePiece(PAWN, color)) + promoted > 8) return false;
+	}
+#if KF_ATTACK_MAPS
+	refreshAttackMaps(b);
+#endif
 
-	// Turn
-	assert(fen[pos] == 'w' || fen[pos] == 'b');
-	fen.erase(0, pos);
-	b.turn = (fen[0] == 'w') ? WHITE : BLACK;
+	// Step 2: Side to move
+	std::string_view turn = nextField(fen);
+	if (turn.size() != 1 || (turn[0] != 'w' && turn[0] != 'b')) return false;
+	b.turn = (turn[0] == 'w') ? WHITE : BLACK;
 	if (b.turn == BLACK) b.key ^= turnKey;
 
-	// Castling rights
-	for (int i = 2; i < 8; ++i) {
-		if (fen[i] == ' ') { 
-			pos = i + 1;
-			break; 
-		}
-		switch (fen[i]) {
-		case 'K': b.castlingRights ^= WK_CASTLING; break;
-		case 'Q': b.castlingRights ^= WQ_CASTLING; break;
-		case 'k': b.castlingRights ^= BK_CASTLING; break;
-		case 'q': b.castlingRights ^= BQ_CASTLING; break;
-		default: break;
+	// The side that just moved cannot be in check
+	if (inCheck(b, !b.turn)) return false;
+
+	// Step 3: Castling rights
+	// Rights that do not match the king and rook placement are dropped rather than rejected
+	std::string_view castling = nextField(fen);
+	if (castling.empty()) return false;
+	if (castling != "-") {
+		for (char chr : castling) {
+			switch (chr) {
+			case 'K': if (b.squares[E1] == W_KING && b.squares[H1] == W_ROOK) b.castlingRights |= WK_CASTLING; break;
+			case 'Q': if (b.squares[E1] == W_KING && b.squares[A1] == W_ROOK) b.castlingRights |= WQ_CASTLING; break;
+			case 'k': if (b.squares[E8] == B_KING && b.squares[H8] == B_ROOK) b.castlingRights |= BK_CASTLING; break;
+			case 'q': if (b.squares[E8] == B_KING && b.squares[A8] == B_ROOK) b.castlingRights |= BQ_CASTLING; break;
+			default: return false;
+			}
 		}
 	}
 	b.key ^= castlingKeys[b.castlingRights];
 
-	// En passant square
-	fen.erase(0, pos);
-	pos = 1;
-	if (fen[0] != '-') {
-		pos++;
-		b.epSquare = (fen[1] - '1') * 8 + (fen[0] - 'a');
-		b.key ^= epKeys[b.epSquare % 8];
-	}
-	else {
-		b.epSquare = -1;
+	// Step 4: En passant square
+	// Like makeMove, we only keep the square if a pawn can actually capture there
+	std::string_view ep = nextField(fen);
+	if (ep.empty()) return false;
+	b.epSquare = -1;
+	if (ep != "-") {
+		if (ep.size() != 2 || ep[0] < 'a' || ep[0] > 'h' || ep[1] != ((b.turn == WHITE) ? '6' : '3')) return false;
+		int sqr = (ep[1] - '1') * 8 + (ep[0] - 'a');
+		if (pawnAttacks[sqr][!b.turn] & b.pieces[PAWN] & b.colors[b.turn]) {
+			b.epSquare = sqr;
+			b.key ^= epKeys[b.epSquare % 8];
+		}
 	}
 
-	// Fifty move rule
-	fen.erase(0, pos);
-	b.fiftyMove = atoi(fen.c_str());
+	return true;
+}
+
+bool parseFen(Board& b, std::string_view fen) {
+	if (!parseFenFields(b, fen)) return false;
 
-	// Initialize move history
-	b.history[0] = b.key;
+	// Step 5: Fifty move counter and move number, both optional
+	std::string_view fiftyMove = nextField(fen);
+	if (!fiftyMove.empty() && !parseCounter(fiftyMove, b.fiftyMove)) return false;
+
+	return true;
 }
 
 std::string toNotation(int sqr) {
@@ -173,7 +312,7 @@ std::string toNotation(const uint16_t& m) {
 	return s;
 }
 
-uint16_t toMove(const Board& b, const std::string& notation) {
+uint16_t toMove(const Board& b, std::string_view notation) {
 	assert(notation.size() >= 4);
 	int from = int(notation[0]) - 97 + (int(notation[1]) - 49) * 8;
 	int to = int(notation[2]) - 97 +  (int(notation[3]) - 49) * 8;
@@ -218,8 +357,10 @@ void printBoard(const Board& b) {
 	std::cout << "Castling rights: " << b.castlingRights << "\n";
 	std::cout << "En passant square: " << b.epSquare << "\n";
 	std::cout << "Fifty move counter: " << b.fiftyMove << "\n";
-	std::cout << "Piece-square table score: " << taperedScore(b.psqt[MG], b.psqt[EG], getPhase(b)) << "\n";
-	std::cout << "Evaluation: " << evaluate(b, WHITE) << "\n";
+	std::cout << "Piece-square table score: " << taperedScore(mgScore(b.psqt), egScore(b.psqt), getPhase(b)) << "\n";
+	// Printing runs beside a search, so it evaluates with tables of its own
+	static EvalTables tables;
+	std::cout << "Evaluation: " << evaluate(b, WHITE, tables) << "\n";
 	std::cout << "Phase: " << getPhase(b) << "\n";
 }
 
@@ -237,17 +378,20 @@ uint64_t perft(Board& b, int depth, int ply) {
 	auto moves = genAllMoves(b);
 	bool haveMove = false;
 	for (int i = 0, size = moves.size(); i < size; ++i) {
-		auto u = makeMove(b, moves[i]);
-		if (!inCheck(b, !b.turn)) {
-			uint64_t nodes = perft(b, depth - 1, ply + 1);
+		MoveState state;
+		Board& child = state.make(b, moves[i]);
+		if (!inCheck(child, !child.turn)) {
+			uint64_t nodes = perft(child, depth - 1, ply + 1);
 			count += nodes;
 			haveMove = true;
 			if (!ply) std::cout << toNotation(moves[i]) << " " << nodes << "\n";
 		}
-		undoMove(b, moves[i], u);
+		state.undo(b, moves[i]);
 	}
 	// if (haveMove) { storePTT(b.key, depth, count); }
 	if (!ply) std::cout << "Nodes: " << count << "\n";
 	if (!ply) std::cout << "Time: " << (double)(clock() - start) / (CLOCKS_PER_SEC / 1000) << "\n";
 	return (haveMove) ? count : 0ull;
+}
+
 }
\ No newline at end of file
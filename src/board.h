@@ -1,46 +1,138 @@
 #ifndef BOARD_H
 #define BOARD_H
 
+#include "cpu.h"
 #include "types.h"
 
+// Build with -DKF_ATTACK_MAPS=1 to keep per-color attack maps in the board, updated incrementally by makeMove and undoMove
+// Check detection then reads the maps, but keeping them up to date costs more than it saves on bench, so it is off by default
+#ifndef KF_ATTACK_MAPS
+#define KF_ATTACK_MAPS 0
+#endif
+
+// Eight promoted pawns and the two pieces of that kind from the start, parseFen rejects positions that could exceed it
+static constexpr int maxPieceCount = 10;
+
+static constexpr int maxFenCounter = 999999;
+
+// Only knights, bishops, rooks and queens have a list, pawns are visited through their bitboard and kings have kingSquares
+// A list packs ten 6-bit squares into the low 60 bits of a word and the number of squares into the top 4 bits
+static constexpr int pieceListNum = 8;
+static constexpr int pieceListIndex[12] = { -1, 0, 1, 2, 3, -1, -1, 4, 5, 6, 7, -1 };
+static constexpr int pieceListCountShift = 60;
+static constexpr uint64_t pieceListCountOne = 1ull << pieceListCountShift;
+
+// Only the state needed to generate and evaluate moves, so that copying a board stays cheap
+// The keys of earlier positions live in a KeyHistory next to it
 struct Board {
-	int squares[SQUARE_NUM];
+	uint8_t squares[SQUARE_NUM];
 	uint64_t pieces[6];
 	uint64_t colors[3];  // White, black, no color
 	uint64_t key;
-	uint64_t history[MAX_MOVES];
-	int moveNum;
+	uint64_t materialKey;  // Piece counts, see material.h
+	uint64_t pawnKey;  // Zobrist key of the pawns only
 	int turn;
 	int epSquare;
 	int castlingRights;
-	int psqt[2];
+	PackedScore psqt;  // From white's point of view
+	int phase;  // Sum of the phase weights of all pieces, can exceed maxPhase after promotions
+	int nonPawnMaterial[2];  // Middlegame values of the knights, bishops, rooks and queens of each side
 	int fiftyMove;
+	const Accumulator* accumulator;  // Network sums while NNUE is in use, null if they have not been computed
+	uint8_t kingSquares[2];
+	uint64_t pieceLists[pieceListNum];  // Squares of each piece, in no particular order
+#if KF_ATTACK_MAPS
+	uint64_t attacks[2];  // Squares attacked by each color
+	uint8_t attackCounts[2][SQUARE_NUM];  // Number of pieces of each color attacking a square
+#endif
+};
+
+// Piece lists are kept next to the bitboards, so that the few pieces of a kind can be visited without scanning a bitboard
+// The lists hold at most ten squares, so a piece is found by a short scan instead of keeping a per-square index
+// A removed piece is replaced by the last one in its list, and unused slots are kept at zero
+static inline int listCount(uint64_t list) {
+	return list >> pieceListCountShift;
+}
+
+static inline int listSquare(uint64_t list, int i) {
+	return (list >> (6 * i)) & 63;
+}
+
+static inline int listSlot(uint64_t list, int sqr) {
+	int i = 0;
+	while (listSquare(list, i) != sqr) ++i;
+	return i;
+}
+
+static inline void addPiece(Board& b, int piece, int sqr) {
+	if (pieceListIndex[piece] < 0) return;
+	uint64_t& list = b.pieceLists[pieceListIndex[piece]];
+	list += ((uint64_t)sqr << (6 * listCount(list))) + pieceListCountOne;
+}
+
+static inline void removePiece(Board& b, int piece, int sqr) {
+	if (pieceListIndex[piece] < 0) return;
+	uint64_t& list = b.pieceLists[pieceListIndex[piece]];
+	const int last = listCount(list) - 1;
+	const uint64_t lastSquare = listSquare(list, last);
+	list ^= (uint64_t)(sqr ^ lastSquare) << (6 * listSlot(list, sqr));
+	list ^= lastSquare << (6 * last);
+	list -= pieceListCountOne;
+}
+
+static inline void movePiece(Board& b, int piece, int from, int to) {
+	if (pieceListIndex[piece] < 0) return;
+	uint64_t& list = b.pieceLists[pieceListIndex[piece]];
+	list ^= (uint64_t)(from ^ to) << (6 * listSlot(list, from));
+}
+
+// Keys of all positions since the last position command, used to detect repetitions
+// The game keeps one for the moves sent by the GUI, the search extends a copy of it along the current line
+struct KeyHistory {
+	std::vector<uint64_t> keys;
+
+	void reset(uint64_t key) {
+		keys.clear();
+		keys.push_back(key);
+	}
+
+	void push(uint64_t key) {
+		keys.push_back(key);
+	}
+
+	void pop() {
+		keys.pop_back();
+	}
 };
 
 struct Undo {
 	Undo() {
 		key = 0;
+		materialKey = 0;
+		pawnKey = 0;
 		epSquare = -1;
 		castlingRights = 0;
 		fiftyMove = 0;
-		psqt[MG] = 0;
-		psqt[EG] = 0;
+		psqt = 0;
 		capturedPiece = EMPTY;
 	}
-	Undo(uint64_t keyParam, int epParam, int castleParam, int fiftyParam, int psqtMGParam, int psqtEGParam, int capturedParam) {
+	Undo(uint64_t keyParam, uint64_t materialKeyParam, uint64_t pawnKeyParam, int epParam, int castleParam, int fiftyParam, PackedScore psqtParam, int capturedParam) {
 		key = keyParam;
+		materialKey = materialKeyParam;
+		pawnKey = pawnKeyParam;
 		epSquare = epParam;
 		castlingRights = castleParam;
 		fiftyMove = fiftyParam;
-		psqt[MG] = psqtMGParam;
-		psqt[EG] = psqtEGParam;
+		psqt = psqtParam;
 		capturedPiece = capturedParam;
 	}
 	uint64_t key;
+	uint64_t materialKey;
+	uint64_t pawnKey;
 	int epSquare;
 	int castlingRights;
 	int fiftyMove;
-	int psqt[2];
+	PackedScore psqt;
 	int capturedPiece;
 };
 
@@ -49,25 +141,66 @@ extern uint64_t castlingKeys[16];
 extern uint64_t epKeys[8];
 extern uint64_t turnKey;
 
+// Cuckoo tables of all reversible piece moves, keyed by the change they make to the position key
+// Used to find positions from which a single move repeats an earlier one
+static constexpr int cuckooSize = 8192;
+
+static inline int cuckooHash1(uint64_t key) {
+	return key & (cuckooSize - 1);
+}
+
+static inline int cuckooHash2(uint64_t key) {
+	return (key >> 16) & (cuckooSize - 1);
+}
+
+extern uint64_t cuckooKeys[cuckooSize];
+extern uint16_t cuckooMoves[cuckooSize];
+
 static constexpr char pieceChars[13] {
 	'P', 'N', 'B', 'R', 'Q', 'K', 'p', 'n', 'b', 'r', 'q', 'k', ' '
 };
 
+struct PieceCharTable {
+	int8_t pieces[256];
+	constexpr PieceCharTable() : pieces() {
+		for (auto& p : pieces) p = EMPTY;
+		for (int i = W_PAWN; i <= B_KING; ++i) pieces[(unsigned char)pieceChars[i]] = i;
+	}
+	constexpr int operator[](unsigned char c) const { return pieces[c]; }
+};
+
+static constexpr std::string_view startFen = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+
+// Maps FEN characters to pieces without searching pieceChars
+static constexpr PieceCharTable pieceFromChar;
+
+inline namespace KF_ISA {
+
 void initKeys();
+void initCuckoo();
 
 void clearBoard(Board& b);
 void setSquare(Board&b, int piece, int sqr);
 
-bool drawnByRepetition(const Board& b);
+bool drawnByRepetition(const Board& b, const KeyHistory& history);
+bool insufficientMaterial(const Board& b);
+bool isDraw(const Board& b, const KeyHistory& history);
+bool hasUpcomingRepetition(const Board& b, const KeyHistory& history, int ply);
+
+// Move counters of FEN and EPD records, plain decimal numbers from 0 to maxFenCounter
+bool parseCounter(std::string_view field, int& value);
 
-void parseFen(Board& b, std::string fen);
+bool parseFenFields(Board& b, std::string_view& fen);
+bool parseFen(Board& b, std::string_view fen);
 
 std::string toNotation(int sqr);
 std::string toNotation(const uint16_t& m);
-uint16_t toMove(const Board& b, const std::string& notation);
+uint16_t toMove(const Board& b, std::string_view notation);
 
 void printBoard(const Board& b);
 
 uint64_t perft(Board& b, int depth, int ply);
 
+}
+
 #endif
\ No newline at end of file
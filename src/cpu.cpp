@@ -0,0 +1,77 @@
+#include "cpu.h"
+#include "types.h"
+
+#if KF_X86_DISPATCH
+#include <cpuid.h>
+#endif
+
+CPUInfo cpu;
+
+void initCPU() {
+#if KF_X86_DISPATCH
+	__builtin_cpu_init();
+
+	cpu.popcnt = __builtin_cpu_supports("popcnt");
+	cpu.bmi1 = __builtin_cpu_supports("bmi");
+	cpu.bmi2 = __builtin_cpu_supports("bmi2");
+
+	if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) cpu.simd = SIMD_AVX512;
+	else if (__builtin_cpu_supports("avx2")) cpu.simd = SIMD_AVX2;
+	else if (__builtin_cpu_supports("sse2")) cpu.simd = SIMD_SSE2;
+
+	// AMD implemented PEXT in microcode until Zen 3 (family 19h), where it is slower than a magic multiply
+	cpu.fastPext = cpu.bmi2;
+	if (cpu.bmi2 && __builtin_cpu_is("amd")) {
+		unsigned int eax, ebx, ecx, edx;
+		if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+			unsigned int family = (eax >> 8) & 0xf;
+			if (family == 0xf) family += (eax >> 20) & 0xff;
+			cpu.fastPext = (family >= 0x19);
+		}
+	}
+
+	// CPUs with BMI2 also have LZCNT, which the BMI2 copy uses for msb
+	// Where PEXT is slow the magics are faster, so those CPUs run the POPCNT copy
+	if (cpu.popcnt && cpu.bmi1 && cpu.fastPext) cpu.isa = ISA_BMI2;
+	else if (cpu.popcnt) cpu.isa = ISA_POPCNT;
+#endif
+}
+
+std::string cpuFeatureString() {
+	std::string s;
+	if (cpu.popcnt) s += " popcnt";
+	if (cpu.bmi1) s += " bmi1";
+	if (cpu.bmi2) s += " bmi2";
+	if (cpu.simd >= SIMD_SSE2) s += " sse2";
+	if (cpu.simd >= SIMD_AVX2) s += " avx2";
+	if (cpu.simd >= SIMD_AVX512) s += " avx512";
+	return s.empty() ? "none" : s.substr(1);
+}
+
+std::string cpuKernelString() {
+	static const std::string simdNames[4] = { "none", "sse2", "avx2", "avx512" };
+#if defined(__POPCNT__)
+	bool popcnt = true;
+#else
+	bool popcnt = false;
+#endif
+#if defined(__BMI__)
+	bool bmi = true;
+#else
+	bool bmi = false;
+#endif
+	bool pext = KF_PEXT;
+
+	// The copies add to what the build targets, see KF_ISA
+	if (cpu.isa >= ISA_POPCNT) popcnt = true;
+	if (cpu.isa == ISA_BMI2) bmi = pext = true;
+
+	std::string s;
+	s += (popcnt) ? "popcount popcnt" : "popcount generic";
+	s += (bmi) ? " bitscan bmi1" : " bitscan generic";
+	s += (pext) ? " sliders pext" : " sliders magic";
+	if (pext && !cpu.fastPext) s += " (slow on this CPU)";
+	s += " simd ";
+	s += simdNames[cpu.simd];
+	return s;
+}
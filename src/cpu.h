@@ -0,0 +1,54 @@
+#ifndef CPU_H
+#define CPU_H
+
+#include "types.h"
+
+// The network kernels are compiled for several ISA levels in the same binary
+// The best version is picked once per evaluation from CPUID, which is coarse enough that the dispatch costs nothing
+#if defined(__GNUC__) && defined(__x86_64__)
+#define KF_X86_DISPATCH 1
+#define KF_TARGET(isa) __attribute__((target(isa)))
+#else
+#define KF_X86_DISPATCH 0
+#define KF_TARGET(isa)
+#endif
+
+// Bitboard helpers and slider lookups are too small for that, so the hot code (search, move generation and evaluation) is compiled once per ISA level instead
+// isa_popcnt.cpp and isa_bmi2.cpp include it again with KF_ISA set, each copy lives in its own inline namespace
+// Calls inside a copy stay inside it and keep inlining the helpers, the copy for the CPU is picked once by initEntryPoints
+#ifndef KF_ISA
+#define KF_ISA isaDefault
+#define KF_ISA_COPY 0
+#else
+#define KF_ISA_COPY 1
+#endif
+
+// The BMI2 copy indexes the slider tables with PEXT, and so does the default copy of a build for BMI2 (e.g. -march=haswell)
+#ifndef KF_PEXT
+#if defined(__BMI2__) && defined(__x86_64__)
+#define KF_PEXT 1
+#else
+#define KF_PEXT 0
+#endif
+#endif
+
+enum IsaLevel { ISA_DEFAULT, ISA_POPCNT, ISA_BMI2 };
+enum SimdLevel { SIMD_NONE, SIMD_SSE2, SIMD_AVX2, SIMD_AVX512 };
+
+struct CPUInfo {
+	bool popcnt = false;
+	bool bmi1 = false;
+	bool bmi2 = false;
+	bool fastPext = false;  // PEXT is microcoded on AMD before Zen 3
+	int isa = ISA_DEFAULT;  // The copy of the hot code to run, see KF_ISA
+	int simd = SIMD_NONE;
+};
+
+extern CPUInfo cpu;
+
+void initCPU();
+
+std::string cpuFeatureString();
+std::string cpuKernelString();
+
+#endif
@@ -0,0 +1,161 @@
+#include <chrono>
+
+#include "board.h"
+#include "epd.h"
+#include "types.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define KF_MMAP 1
+#else
+#include <fstream>
+#define KF_MMAP 0
+#endif
+
+bool MappedFile::open(const std::string& path) {
+	close();
+#if KF_MMAP
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		::close(fd);
+		return false;
+	}
+	size = st.st_size;
+	if (size == 0) {
+		::close(fd);
+		data = "";
+		return true;
+	}
+	void* addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (addr == MAP_FAILED) {
+		size = 0;
+		return false;
+	}
+	// Positions are read front to back exactly once
+	madvise(addr, size, MADV_SEQUENTIAL);
+	data = static_cast<const char*>(addr);
+	mapped = true;
+	return true;
+#else
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (!file) return false;
+	buffer.resize(file.tellg());
+	file.seekg(0);
+	file.read(buffer.data(), buffer.size());
+	data = buffer.data();
+	size = buffer.size();
+	return true;
+#endif
+}
+
+void MappedFile::close() {
+#if KF_MMAP
+	if (mapped) munmap(const_cast<char*>(data), size);
+#endif
+	mapped = false;
+	buffer.clear();
+	data = nullptr;
+	size = 0;
+}
+
+bool parseEPD(Board& b, std::string_view line, EPDInfo& info) {
+	info.count = 0;
+	if (!parseFenFields(b, line)) return false;
+
+	bool counters = false;
+	while (1) {
+		while (!line.empty() && isspace((unsigned char)line.front())) line.remove_prefix(1);
+		if (line.empty()) break;
+
+		// Full FEN lines carry the fifty move counter and move number instead of opcodes
+		if (!counters && info.count == 0 && isdigit((unsigned char)line.front())) {
+			size_t end = 0;
+			while (end < line.size() && isdigit((unsigned char)line[end])) end++;
+			if (!parseCounter(line.substr(0, end), b.fiftyMove)) return false;
+			line.remove_prefix(end);
+
+			// Skip the move number
+			while (!line.empty() && line.front() == ' ') line.remove_prefix(1);
+			while (!line.empty() && isdigit((unsigned char)line.front())) line.remove_prefix(1);
+			counters = true;
+			continue;
+		}
+
+		// Opcode, then operands up to the next semicolon that is not inside a string
+		size_t end = 0;
+		while (end < line.size() && !isspace((unsigned char)line[end]) && line[end] != ';') end++;
+		std::string_view opcode = line.substr(0, end);
+		line.remove_prefix(end);
+
+		bool quoted = false;
+		end = 0;
+		while (end < line.size() && (quoted || line[end] != ';')) {
+			if (line[end] == '"') quoted = !quoted;
+			end++;
+		}
+		if (quoted) return false;
+
+		std::string_view operands = line.substr(0, end);
+		while (!operands.empty() && isspace((unsigned char)operands.front())) operands.remove_prefix(1);
+		while (!operands.empty() && isspace((unsigned char)operands.back())) operands.remove_suffix(1);
+		line.remove_prefix(std::min(end + 1, line.size()));
+
+		if (opcode.empty()) continue;
+		if (info.count < maxEPDOperations) info.ops[info.count++] = { opcode, operands };
+
+		if (opcode == "hmvc" && !parseCounter(operands, b.fiftyMove)) return false;
+	}
+
+	return true;
+}
+
+void benchFenFile(const std::string& path) {
+	MappedFile file;
+	if (!file.open(path)) {
+		std::cout << "info string Could not open " << path << "\n";
+		return;
+	}
+
+	Board b;
+	EPDInfo info;
+	uint64_t positions = 0;
+	uint64_t invalid = 0;
+	uint64_t checksum = 0;
+
+	auto start = std::chrono::steady_clock::now();
+
+	const char* cur = file.data;
+	const char* end = file.data + file.size;
+	while (cur < end) {
+		const char* next = static_cast<const char*>(memchr(cur, '\n', end - cur));
+		if (!next) next = end;
+		std::string_view line(cur, next - cur);
+		cur = next + 1;
+
+		if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+		if (line.empty() || line.front() == '#') continue;
+
+		if (parseEPD(b, line, info)) {
+			positions++;
+			checksum ^= b.key;
+		}
+		else {
+			invalid++;
+		}
+	}
+
+	auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+	double seconds = std::max<int64_t>(elapsed, 1) / 1000000.0;
+
+	std::cout << "Positions: " << positions << "\n";
+	std::cout << "Invalid: " << invalid << "\n";
+	std::cout << "Time: " << elapsed / 1000 << "\n";
+	std::cout << "Positions/second: " << (uint64_t)((positions + invalid) / seconds) << "\n";
+	std::cout << "Checksum: " << checksum << "\n";
+}
@@ -0,0 +1,51 @@
+#ifndef EPD_H
+#define EPD_H
+
+#include "types.h"
+
+static constexpr int maxEPDOperations = 16;
+
+// An EPD operation such as bm Nf3; or id "pos 1";
+// Both views point into the parsed line, nothing is copied
+struct EPDOperation {
+	std::string_view opcode;
+	std::string_view operands;
+};
+
+struct EPDInfo {
+	int count = 0;
+	EPDOperation ops[maxEPDOperations];
+
+	std::string_view find(std::string_view opcode) const {
+		for (int i = 0; i < count; ++i) {
+			if (ops[i].opcode == opcode) return ops[i].operands;
+		}
+		return std::string_view();
+	}
+};
+
+// A read-only view of a whole file, memory-mapped where the platform supports it
+struct MappedFile {
+	const char* data = nullptr;
+	size_t size = 0;
+
+	MappedFile() = default;
+	~MappedFile() { close(); }
+
+	// A copy would unmap the file a second time when destroyed
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool open(const std::string& path);
+	void close();
+
+private:
+	bool mapped = false;
+	std::vector<char> buffer;
+};
+
+bool parseEPD(Board& b, std::string_view line, EPDInfo& info);
+
+void benchFenFile(const std::string& path);
+
+#endif
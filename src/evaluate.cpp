@@ -3,156 +3,134 @@
 #include "board.h"
 #include "evaluate.h"
 #include "masks.h"
+#include "material.h"
+#include "nnue.h"
+#include "pawns.h"
 #include "tt.h"
 #include "types.h"
 
-int psqtScore(int piece, int sqr, int phase) {
-	switch (piece) {
-	default:
-		return 0;
-	case PAWN:
-		return pawnPSQT[sqr];
-	case KNIGHT:
-		return knightPSQT[phase][sqr];
-	case BISHOP:
-		return bishopPSQT[phase][sqr];
-	case ROOK:
-		return rookPSQT[phase][sqr];
-	case QUEEN:
-		return queenPSQT[phase][sqr];
-	case KING:
-		return kingPSQT[phase][sqr];
-	}
+// Unpacks a white score, scales the endgame part for drawish material and tapers it by game phase
+// An overload of taperedScore in evaluate.h, so it sits next to it outside the namespace
+static inline int taperedScore(PackedScore score, const MaterialEntry& me) {
+	int mg = mgScore(score);
+	int eg = egScore(score);
+	eg = eg * me.scale[(eg > 0) ? WHITE : BLACK] / scaleNormal;
+	return taperedScore(mg, eg, me.phase);
 }
 
-int evaluate(const Board& b, int color) {
-	int phase = getPhase(b);
+inline namespace KF_ISA {
+
+int evaluate(const Board& b, int color, EvalTables& tables) {
+	bool lazy;
+	return evaluate(b, color, tables, -MATE_SCORE, MATE_SCORE, lazy);
+}
+
+int evaluate(const Board& b, int color, EvalTables& tables, int alpha, int beta, bool& lazy) {
+	lazy = false;
+
+	// Step 1: Material
+	// Piece values, material imbalance and game phase only depend on the piece counts, so they are cached by material key
+	// The value of pieces change slightly as the game progresses to reflect their changing importance (e.g. pawns are more important in the endgame)
+	const MaterialEntry& me = probeMaterial(tables.material, b);
+	if (me.evaluator) {
+		int eval = me.evaluator(b, me);
+		return (color == WHITE) ? eval : -eval;
+	}
+
+	// The network replaces everything else, it scores the position for the side to move
+	if (useNNUE) {
+		int eval = evaluateNNUE(b);
+		return (color == b.turn) ? eval : -eval;
+	}
+
+	int phase = me.phase;
 	EvalInfo ei;
+	PackedScore score = me.score;
 
-	ei.kingRings[WHITE] = kingRing[lsb(b.pieces[KING] & b.colors[WHITE])];
-	ei.kingRings[BLACK] = kingRing[lsb(b.pieces[KING] & b.colors[BLACK])];
+	ei.kingRings[WHITE] = kingRing[b.kingSquares[WHITE]];
+	ei.kingRings[BLACK] = kingRing[b.kingSquares[BLACK]];
 
+	ei.pawnEntry = &probePawns(tables.pawns, b);
 	ei.pawns[WHITE] = b.pieces[PAWN] & b.colors[WHITE];
 	ei.pawns[BLACK] = b.pieces[PAWN] & b.colors[BLACK];
 
-	ei.safeSquares[WHITE] = ~(((ei.pawns[BLACK] >> 7) & ~fileAMask) | ((ei.pawns[BLACK] >> 9) & ~fileHMask)) & b.colors[NO_COLOR];
-	ei.safeSquares[BLACK] = ~(((ei.pawns[WHITE] << 7) & ~fileHMask) | ((ei.pawns[WHITE] << 9) & ~fileAMask)) & b.colors[NO_COLOR];
+	ei.safeSquares[WHITE] = ~ei.pawnEntry->attacks[BLACK] & b.colors[NO_COLOR];
+	ei.safeSquares[BLACK] = ~ei.pawnEntry->attacks[WHITE] & b.colors[NO_COLOR];
 	ei.attackSquares[WHITE] = ~ei.safeSquares[BLACK];
 	ei.attackSquares[BLACK] = ~ei.safeSquares[WHITE];
 
-	// Step 1: Material
-	// The value of pieces change slightly as the game progresses to reflect their changing importance (e.g. pawns are more important in the endgame)
-	for (int i = PAWN; i <= QUEEN; ++i) {
-		ei.mg += countBits(b.pieces[i] & b.colors[WHITE]) * pieceValues[i][MG];
-		ei.eg += countBits(b.pieces[i] & b.colors[WHITE]) * pieceValues[i][EG];
-
-		ei.mg -= countBits(b.pieces[i] & b.colors[BLACK]) * pieceValues[i][MG];
-		ei.eg -= countBits(b.pieces[i] & b.colors[BLACK]) * pieceValues[i][EG];
-	}
-
 	// Step 2: Piece-square tables
 	// A basic evaluation of the placement of pieces
-	ei.mg += b.psqt[MG];
-	ei.eg += b.psqt[EG];
+	score += b.psqt;
 	
 	// Step 3: Evaluate pawns
-	evaluatePawns(b, ei, WHITE);
-	evaluatePawns(b, ei, BLACK);
-
-	// Step 4: Evaluate knights, bishops, rooks and queens
-	evaluateKnights(b, ei, WHITE);
-	evaluateKnights(b, ei, BLACK);
-
-	evaluateBishops(b, ei, WHITE);
-	evaluateBishops(b, ei, BLACK);
-
-	evaluateRooks(b, ei, WHITE);
-	evaluateRooks(b, ei, BLACK);
+	score += evaluatePawns<WHITE>(b, ei) - evaluatePawns<BLACK>(b, ei);
+
+	// Step 4: Lazy evaluation
+	// The remaining terms rarely add up to more than a margin, so if the score so far is already that far outside the
+	// window, the full evaluation would not change the outcome and we return early
+	int lazyEval = taperedScore(score, me);
+	lazyEval = (color == WHITE) ? lazyEval : -lazyEval;
+	if (lazyEval - lazyMargin >= beta || lazyEval + lazyMargin <= alpha) {
+		lazy = true;
+		return lazyEval;
+	}
 
-	evaluateQueens(b, ei, WHITE);
-	evaluateQueens(b, ei, BLACK);
+	// Step 5: Evaluate knights, bishops, rooks and queens
+	// Both colors only add to their own attack maps, so the order within a step does not matter
+	score += evaluateKnights<WHITE>(b, ei) - evaluateKnights<BLACK>(b, ei);
+	score += evaluateBishops<WHITE>(b, ei) - evaluateBishops<BLACK>(b, ei);
+	score += evaluateRooks<WHITE>(b, ei) - evaluateRooks<BLACK>(b, ei);
+	score += evaluateQueens<WHITE>(b, ei) - evaluateQueens<BLACK>(b, ei);
 	
-	// Step 5: Evaluate kings
-	evaluateKing(b, ei, WHITE);
-	evaluateKing(b, ei, BLACK);
+	// Step 6: Evaluate kings
+	score += evaluateKing<WHITE>(b, ei) - evaluateKing<BLACK>(b, ei);
 
-	// Step 6: Evaluate space
+	// Step 7: Evaluate space
 	if (phase >= spacePhaseLimit) {
-		evaluateSpace(b, ei, WHITE);
-		evaluateSpace(b, ei, BLACK);
+		score += evaluateSpace<WHITE>(b, ei) - evaluateSpace<BLACK>(b, ei);
 	}
 
-	// Step 7: Tempo bonus
-	ei.mg += (b.turn == WHITE) ? tempoBonus : -tempoBonus;
-	ei.eg += (b.turn == WHITE) ? tempoBonus : -tempoBonus;
+	// Step 8: Tempo bonus
+	score += (b.turn == WHITE) ? tempoBonus : -tempoBonus;
 
-	// Step 8: Evaluate threats
-	evaluateThreats(b, ei, WHITE);
-	evaluateThreats(b, ei, BLACK);
+	// Step 9: Evaluate threats
+	score += evaluateThreats<WHITE>(b, ei) - evaluateThreats<BLACK>(b, ei);
 
-	int eval = taperedScore(ei.mg, ei.eg, phase);
+	// Step 10: Endgame scaling and tapering
+	// Drawish material reduces the endgame score of the side that is ahead
+	int eval = taperedScore(score, me);
 	return (color == WHITE) ? eval : -eval;
 }
 
-void evaluatePawns(const Board& b, EvalInfo& ei, int color) {
-	// Step 0: Probe pawn hash table
-	// As pawn structures are often the same for similar positions, we check if we have evaluated this pawn structure before
-	int hashEval = probePawnHash(ei.pawns[color], color);
-	int mg = 0;
-	int eg = 0;
-	uint64_t pawns = ei.pawns[color];
-
-	if (hashEval != NO_VALUE) {
-		mg = hashEval;
-	} else {
-		// Step 1: Supported pawns
-		// We give a bonus to pawns that defend each other
-		mg += (countBits((pawns & ((color == WHITE) ? (pawns >> 7) & ~fileAMask : (pawns << 7) & ~fileHMask)) |
-						(pawns & ((color == WHITE) ? (pawns >> 9) & ~fileHMask : (pawns << 9) & ~fileAMask)))) *
-						supportedPawnBonus;
-
-		// Step 2: Phalanx pawns
-		// We give a bonus to pawns that are beside each other
-		mg += (countBits((pawns & (pawns >> 1) & ~fileHMask) | (pawns & (pawns << 1) & ~fileAMask))) * phalanxPawnBonus;
-
-		// Step 3: Doubled pawns
-		// We give a penalty if there are more than one pawns on each file
-		for (int i = 0; i < 8; ++i) {
-			if (countBits(pawns & fileMasks[i]) > 1) mg -= doubledPawnPenalty;
-		}
-
-		storePawnHash(pawns, mg, color);
-	}
-
-	eg = mg; // Update eg score to mg score as the above evaluation terms are not phase-dependent
-
-	while (pawns) {
-		int sqr = popBit(pawns);
-
-		// Step 4: Isolated pawns
-		// We give a penalty if there are pawns that do not have friendly pawns in neighboring files that could support them
-		int isolated = ((neighborFileMasks[sqr % 8] & ~fileMasks[sqr % 8] & b.pieces[PAWN] & b.colors[color]) == 0) * isolatedPawnPenalty;
-		mg -= isolated;
-		eg -= isolated;
-
-		// Step 5: Passed pawn
-		// We give a bonus to pawns that have passed enemy pawns
-		// We reduce the bonus if the passed pawn is being blocked by a piece
-		int passedRank = passed(b, sqr, ei.pawns[!color], color);
+template <int color>
+PackedScore evaluatePawns(const Board& b, EvalInfo& ei) {
+	// Step 1: Pawn structure
+	// Supported, phalanx, doubled and isolated pawns only depend on the pawns, so they come from the pawn hash table
+	const PawnEntry& pe = *ei.pawnEntry;
+	PackedScore score = pe.score[color];
+
+	// Step 2: Passed pawns
+	// We give a bonus to pawns that have passed enemy pawns
+	// We reduce the bonus if the passed pawn is being blocked by a piece
+	uint64_t passedPawns = pe.passed[color];
+	while (passedPawns) {
+		int sqr = popBit(passedPawns);
+		int passedRank = (color == WHITE) ? sqr / 8 : 7 - sqr / 8;
 		bool blocked = (b.squares[sqr + (color == WHITE) * 8] == EMPTY);
-		mg += blocked ? passedBonus[passedRank][MG] : passedBlockedBonus[passedRank][MG];
-		eg += blocked ? passedBonus[passedRank][EG] : passedBlockedBonus[passedRank][EG];
+		score += blocked ? passedBonus[passedRank] : passedBlockedBonus[passedRank];
 	}
 
-	ei.mg += (color == WHITE) ? mg : -mg;
-	ei.eg += (color == WHITE) ? eg : -eg;
+	return score;
 }
 
-void evaluateKnights(const Board& b, EvalInfo& ei, int color) {
+template <int color>
+PackedScore evaluateKnights(const Board& b, EvalInfo& ei) {
 	int eval = 0;
-	uint64_t knights = b.pieces[KNIGHT] & b.colors[color];
-	while (knights) {
-		uint64_t attacks = knightAttacks[popBit(knights)];
+	const int piece = makePiece(KNIGHT, color);
+	const uint64_t list = b.pieceLists[pieceListIndex[piece]];
+	for (int i = 0, count = listCount(list); i < count; ++i) {
+		uint64_t attacks = knightAttacks[listSquare(list, i)];
 		// Mobility
 		eval += knightMobility[countBits(attacks & ei.safeSquares[color])];
 
@@ -165,17 +143,17 @@ void evaluateKnights(const Board& b, EvalInfo& ei, int color) {
 		ei.kingAttackerCount[color] += kingAttacker;
 	}
 	
-	ei.mg += (color == WHITE) ? eval : -eval;
-	ei.eg += (color == WHITE) ? eval : -eval;
+	return makeScore(eval, eval);
 }
 
-void evaluateBishops(const Board& b, EvalInfo& ei, int color) {
+template <int color>
+PackedScore evaluateBishops(const Board& b, EvalInfo& ei) {
 	int eval = 0;
-	int count = 0;
-	uint64_t bishops = b.pieces[BISHOP] & b.colors[color];
+	const int piece = makePiece(BISHOP, color);
 	const uint64_t occ = ~b.colors[NO_COLOR];
-	while (bishops) {
-		int sqr = popBit(bishops);
+	const uint64_t list = b.pieceLists[pieceListIndex[piece]];
+	for (int i = 0, count = listCount(list); i < count; ++i) {
+		int sqr = listSquare(list, i);
 		uint64_t attacks = getBishopMagic(occ, sqr);
 		attacks &= ~b.colors[b.turn];
 
@@ -194,22 +172,19 @@ void evaluateBishops(const Board& b, EvalInfo& ei, int color) {
 		bool kingAttacker = (countBits(attacks & ei.kingRings[!color]) > 0);
 		ei.kingAttackCount[color] += kingAttacker * kingAttackWeight[BISHOP];
 		ei.kingAttackerCount[color] += kingAttacker;
-
-		count++;
 	}
-	// Bishop pair bonus
-	if (count >= 2) eval += bishopPairBonus;
 	
-	ei.mg += (color == WHITE) ? eval : -eval;
-	ei.eg += (color == WHITE) ? eval : -eval;
+	return makeScore(eval, eval);
 }
 
-void evaluateRooks(const Board& b, EvalInfo& ei, int color) {
+template <int color>
+PackedScore evaluateRooks(const Board& b, EvalInfo& ei) {
 	int eval = 0;
-	uint64_t rooks = b.pieces[ROOK] & b.colors[color];
+	const int piece = makePiece(ROOK, color);
 	const uint64_t occ = ~b.colors[NO_COLOR];
-	while (rooks) {
-		int sqr = popBit(rooks);
+	const uint64_t list = b.pieceLists[pieceListIndex[piece]];
+	for (int i = 0, count = listCount(list); i < count; ++i) {
+		int sqr = listSquare(list, i);
 		uint64_t attacks = getRookMagic(occ, sqr);
 		attacks &= ~b.colors[b.turn];
 		// Mobility
@@ -224,19 +199,20 @@ void evaluateRooks(const Board& b, EvalInfo& ei, int color) {
 		ei.kingAttackerCount[color] += kingAttacker;
 
 		// Semi-open and open file bonus
-		eval += rookFileBonus[openFile(b, sqr % 8)];
+		eval += rookFileBonus[ei.pawnEntry->openFile(sqr % 8)];
 	}
 
-	ei.mg += (color == WHITE) ? eval : -eval;
-	ei.eg += (color == WHITE) ? eval : -eval;
+	return makeScore(eval, eval);
 }
 
-void evaluateQueens(const Board& b, EvalInfo& ei, int color) {
+template <int color>
+PackedScore evaluateQueens(const Board& b, EvalInfo& ei) {
 	int eval = 0;
-	uint64_t queens = b.pieces[QUEEN] & b.colors[color];
+	const int piece = makePiece(QUEEN, color);
 	const uint64_t occ = ~b.colors[NO_COLOR];
-	while (queens) {
-		int sqr = popBit(queens);
+	const uint64_t list = b.pieceLists[pieceListIndex[piece]];
+	for (int i = 0, count = listCount(list); i < count; ++i) {
+		int sqr = listSquare(list, i);
 		uint64_t attacks = (getBishopMagic(occ, sqr) | getRookMagic(occ, sqr)) & ~b.colors[b.turn];
 		// Mobility
 		eval += queenMobility[countBits(attacks & ei.safeSquares[color])];
@@ -249,46 +225,46 @@ void evaluateQueens(const Board& b, EvalInfo& ei, int color) {
 		ei.kingAttackCount[color] += kingAttacker * kingAttackWeight[QUEEN];
 		ei.kingAttackerCount[color] += kingAttacker;
 	}
-	ei.mg += (color == WHITE) ? eval : -eval;
-	ei.eg += (color == WHITE) ? eval : -eval;
+	return makeScore(eval, eval);
 }
 
-void evaluateKing(const Board& b, EvalInfo& ei, int color) {
+template <int color>
+PackedScore evaluateKing(const Board& b, EvalInfo& ei) {
 	int mg = 0;
-	int eg = 0;
 
-	int kingSquare = lsb(b.pieces[KING] & b.colors[color]);
+	int kingSquare = b.kingSquares[color];
 
 	// We give a penalty if our king ring is attacked by enemy pieces
 	// The penalty follows a sigmoid curve with the number of attacking pieces
 	mg -= ei.kingAttackCount[!color] * kingAttackPenalty * kingAttackerWeight[std::min(ei.kingAttackerCount[!color], 7)] / 24;
 
 
-	uint64_t shelter = ei.kingRings[color] & rankMasks[kingSquare / 8 + ((color == WHITE) ? 1 : -1)] & ~(rank1Mask | rank8Mask) |
-						(((1ull << kingSquare) >> 1) & ~fileHMask) | (((1ull << kingSquare) << 1) & ~fileAMask);
-	mg += kingShelterBonus[countBits(shelter & b.pieces[PAWN] & b.colors[color])];
+	// We give a bonus for our pawns in front of and beside the king
+	mg += kingShelter(b, *ei.pawnEntry, color, kingSquare);
 
 	// We penalise weak squares near king (king ring squares that are attacked but not defended by our pieces or pawns)
 	// int weak = countBits(ei.attackSquares[!color] & ~ei.attackSquares[color] & ei.kingRings[color]) * weakSquarePenalty;
 	// mg -= weak;
-	// eg -= weak;
 
 	// We give a penalty if the king is on a semi-open or open file
-	mg -= kingFilePenalty[openFile(b, kingSquare % 8)];
+	mg -= kingFilePenalty[ei.pawnEntry->openFile(kingSquare % 8)];
 
-	ei.mg += (color == WHITE) ? mg : -mg;
-	ei.eg += (color == WHITE) ? eg : -eg;
+	// King safety only matters while there is material left to attack with
+	return makeScore(mg, 0);
 }
 
-void evaluateSpace(const Board& b, EvalInfo& ei, int color) {
-	int pieceCount = countBits(b.colors[color] & ~b.pieces[PAWN] & ~b.pieces[KING]);
+template <int color>
+PackedScore evaluateSpace(const Board& b, EvalInfo& ei) {
+	int pieceCount = 0;
+	for (int type = KNIGHT; type <= QUEEN; ++type) pieceCount += listCount(b.pieceLists[pieceListIndex[makePiece(type, color)]]);
 	uint64_t spaceArea = ei.safeSquares[color] & centerMasks[color] & b.colors[NO_COLOR];
 	int space = countBits(spaceArea) * std::max(pieceCount - 3, 0);
 	
-	ei.mg += (color == WHITE) ? space : -space;
+	return makeScore(space, 0);
 }
 
-void evaluateThreats(const Board& b, EvalInfo& ei, int color) {
+template <int color>
+PackedScore evaluateThreats(const Board& b, EvalInfo& ei) {
 	int eval = 0;
 
 	// Step 1: Safe pawn threat
@@ -299,29 +275,35 @@ void evaluateThreats(const Board& b, EvalInfo& ei, int color) {
 														(((safePawns >> 7) & ~fileAMask) | ((safePawns >> 9) & ~fileHMask));
 	eval += safePawnThreatBonus * countBits(safePawnAttackSquares & b.colors[!color] & ~b.pieces[PAWN]);
 	
-	ei.mg += (color == WHITE) ? eval : -eval;
-	ei.eg += (color == WHITE) ? eval : -eval;
-}
-
-int passed(const Board& b, int sqr, const uint64_t& enemyPawns, int color) {
-	int rank = sqr / 8;
-	return (!countBits(passedPawnMasks[sqr][color] & enemyPawns)) ? ((color == WHITE) ? rank : 7 - rank) : 0;
+	return makeScore(eval, eval);
 }
 
 bool isPassed(const Board&b, int sqr, int color) {
 	return (passedPawnMasks[sqr][color] & b.pieces[PAWN] & b.colors[!color] == 0);
 }
 
-int openFile(const Board& b, int file) {
-	uint64_t whitePawnsOnFile = fileMasks[file] & b.pieces[PAWN] & b.colors[WHITE];
-	uint64_t blackPawnsOnFile = fileMasks[file] & b.pieces[PAWN] & b.colors[BLACK];
-	return !whitePawnsOnFile + !blackPawnsOnFile;
-}
 
 int getPhase(const Board& b) {
-	// Game phase is normalized between 24 (middlegame) and 0 (endgame)
-	// We do not consider pawns in calculating game phase
-	return std::min(countBits(b.pieces[KNIGHT] | b.pieces[BISHOP])
-	           + 2 * countBits(b.pieces[ROOK])
-			   + 4 * countBits(b.pieces[QUEEN]), 24);
+	return std::min(b.phase, maxPhase);
+}
+
+// A template is compiled with the target of its first declaration, which precedes the target of a copy, see KF_ISA
+// Instantiating them here gives every copy its own
+template PackedScore evaluatePawns<WHITE>(const Board& b, EvalInfo& ei);
+template PackedScore evaluatePawns<BLACK>(const Board& b, EvalInfo& ei);
+template PackedScore evaluateKnights<WHITE>(const Board& b, EvalInfo& ei);
+template PackedScore evaluateKnights<BLACK>(const Board& b, EvalInfo& ei);
+template PackedScore evaluateBishops<WHITE>(const Board& b, EvalInfo& ei);
+template PackedScore evaluateBishops<BLACK>(const Board& b, EvalInfo& ei);
+template PackedScore evaluateRooks<WHITE>(const Board& b, EvalInfo& ei);
+template PackedScore evaluateRooks<BLACK>(const Board& b, EvalInfo& ei);
+template PackedScore evaluateQueens<WHITE>(const Board& b, EvalInfo& ei);
+template PackedScore evaluateQueens<BLACK>(const Board& b, EvalInfo& ei);
+template PackedScore evaluateKing<WHITE>(const Board& b, EvalInfo& ei);
+template PackedScore evaluateKing<BLACK>(const Board& b, EvalInfo& ei);
+template PackedScore evaluateSpace<WHITE>(const Board& b, EvalInfo& ei);
+template PackedScore evaluateSpace<BLACK>(const Board& b, EvalInfo& ei);
+template PackedScore evaluateThreats<WHITE>(const Board& b, EvalInfo& ei);
+template PackedScore evaluateThreats<BLACK>(const Board& b, EvalInfo& ei);
+
 }
\ No newline at end of file
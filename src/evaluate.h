@@ -1,11 +1,19 @@
 #ifndef EVALUATE_H
 #define EVALUATE_H
 
+#include "cpu.h"
+#include "material.h"
+#include "pawns.h"
 #include "types.h"
 
+// The cached pawn and material terms of one search
+struct EvalTables {
+	PawnTable pawns;
+	MaterialTable material;
+};
+
 struct EvalInfo {
-	int mg = 0;
-	int eg = 0;
+	PawnEntry* pawnEntry;
 
 	int kingAttackCount[2] = { 0, 0 };
 	int kingAttackerCount[2] = { 0, 0 };
@@ -26,6 +34,25 @@ constexpr int pieceValues[5][2] = {
 	{100, 120}, {400, 380}, {420, 400}, {650, 600}, {1350, 1270}
 };
 
+// Game phase goes from 24 with all pieces on the board down to 0 when only kings and pawns are left
+static constexpr int maxPhase = 24;
+
+// Phase weight and middlegame value of each piece, kept as running totals in the board
+// Pawns, kings and EMPTY count for nothing, so captures can update the totals without a branch
+struct PieceMaterialTable {
+	int phase[EMPTY + 1];
+	int nonPawn[EMPTY + 1];
+	constexpr PieceMaterialTable() : phase(), nonPawn() {
+		constexpr int weights[6] = { 0, 1, 1, 2, 4, 0 };
+		for (int p = W_PAWN; p <= B_KING; ++p) {
+			phase[p] = weights[p % 6];
+			nonPawn[p] = (p % 6 >= KNIGHT && p % 6 <= QUEEN) ? pieceValues[p % 6][MG] : 0;
+		}
+	}
+};
+
+static constexpr PieceMaterialTable pieceMaterial;
+
 static constexpr int pawnPSQT[32] = {
 	0,  0,  0,  0,
 	35, 40, 50, 50,
@@ -134,6 +161,44 @@ static constexpr int kingPSQT[2][32] = {
 
 static constexpr int psqtFileTable[8] = { 0, 1, 2, 3, 3, 2, 1, 0 };
 
+static constexpr int psqtScore(int piece, int sqr, int phase) {
+	switch (piece) {
+	default:
+		return 0;
+	case PAWN:
+		return pawnPSQT[sqr];
+	case KNIGHT:
+		return knightPSQT[phase][sqr];
+	case BISHOP:
+		return bishopPSQT[phase][sqr];
+	case ROOK:
+		return rookPSQT[phase][sqr];
+	case QUEEN:
+		return queenPSQT[phase][sqr];
+	case KING:
+		return kingPSQT[phase][sqr];
+	}
+}
+
+// Packed piece-square scores for every piece and square, negated for black so that the board keeps one sum for white
+// The entry for EMPTY lets captures update the sum without a branch
+struct PieceSquareTable {
+	PackedScore scores[EMPTY + 1][SQUARE_NUM];
+	constexpr PieceSquareTable() : scores() {
+		for (int p = W_PAWN; p <= B_KING; ++p) {
+			const int color = p / 6;
+			for (int sqr = 0; sqr < SQUARE_NUM; ++sqr) {
+				const int index = ((color == WHITE) ? 7 - sqr / 8 : sqr / 8) * 4 + psqtFileTable[sqr % 8];
+				const PackedScore score = makeScore(psqtScore(p % 6, index, MG), psqtScore(p % 6, index, EG));
+				scores[p][sqr] = (color == WHITE) ? score : -score;
+			}
+		}
+	}
+	constexpr const PackedScore* operator[](int piece) const { return scores[piece]; }
+};
+
+static constexpr PieceSquareTable pieceSquareTable;
+
 static constexpr int spacePhaseLimit = 12;
 
 static constexpr int supportedPawnBonus = 20;
@@ -141,18 +206,18 @@ static constexpr int phalanxPawnBonus = 20;
 static constexpr int doubledPawnPenalty = 48;
 static constexpr int isolatedPawnPenalty = 14;
 
-static constexpr int passedBonus[7][2] = {
-	{0, 0}, {0, 20}, {5, 40}, {15, 60}, {50, 100}, {120, 180}, {250, 280}
+static constexpr PackedScore passedBonus[7] = {
+	makeScore(0, 0), makeScore(0, 20), makeScore(5, 40), makeScore(15, 60), makeScore(50, 100), makeScore(120, 180), makeScore(250, 280)
 };
 static constexpr int passedBlockReduction = 2;
-static constexpr int passedBlockedBonus[7][2] = {
-	{passedBonus[0][0] / passedBlockReduction, passedBonus[0][1] / passedBlockReduction},
-	{passedBonus[1][0] / passedBlockReduction, passedBonus[1][1] / passedBlockReduction},
-	{passedBonus[2][0] / passedBlockReduction, passedBonus[2][1] / passedBlockReduction},
-	{passedBonus[3][0] / passedBlockReduction, passedBonus[3][1] / passedBlockReduction},
-	{passedBonus[4][0] / passedBlockReduction, passedBonus[4][1] / passedBlockReduction},
-	{passedBonus[5][0] / passedBlockReduction, passedBonus[5][1] / passedBlockReduction},
-	{passedBonus[6][0] / passedBlockReduction, passedBonus[6][1] / passedBlockReduction}
+
+static constexpr PackedScore reducedPassedBonus(int rank) {
+	return makeScore(mgScore(passedBonus[rank]) / passedBlockReduction, egScore(passedBonus[rank]) / passedBlockReduction);
+}
+
+static constexpr PackedScore passedBlockedBonus[7] = {
+	reducedPassedBonus(0), reducedPassedBonus(1), reducedPassedBonus(2), reducedPassedBonus(3),
+	reducedPassedBonus(4), reducedPassedBonus(5), reducedPassedBonus(6)
 };
 
 static constexpr int knightMobility[9]
@@ -183,38 +248,39 @@ static constexpr int weakSquarePenalty = 0; // FIXME: Elo loss
 static constexpr int kingFilePenalty[3] = { 0, 15, 40 };
 
 static constexpr int badBishopPenalty = 4;
-static constexpr int bishopPairBonus = 35;
+static constexpr PackedScore bishopPairBonus = makeScore(35, 35);
 
 static constexpr int rookFileBonus[3] = { 0, 25, 40 };
 
-static constexpr int tempoBonus = 20;
+static constexpr int lazyMargin = 500;
+
+static constexpr PackedScore tempoBonus = makeScore(20, 20);
 
 static constexpr int safePawnThreatBonus = 60;
 
-static inline int psqtSquare(int square, int color) {
-	assert(validSquare(square));
-	return ((color == WHITE) ? 7 - square / 8 : square / 8) * 4 + psqtFileTable[square % 8];
-}
+inline namespace KF_ISA {
 
-int psqtScore(int piece, int sqr, int phase);
+int evaluate(const Board& b, int color, EvalTables& tables);
 
-int evaluate(const Board& b, int color);
+// Stops after material, piece-square tables and pawns when they are already lazyMargin outside [alpha, beta]
+// lazy is set when the returned score is such an estimate, which must not be cached as a static evaluation
+int evaluate(const Board& b, int color, EvalTables& tables, int alpha, int beta, bool& lazy);
 
-void evaluatePawns(const Board& b, EvalInfo& ei, int color);
-void evaluateKnights(const Board& b, EvalInfo& ei, int color);
-void evaluateBishops(const Board& b, EvalInfo& ei, int color);
-void evaluateRooks(const Board& b, EvalInfo& ei, int color);
-void evaluateQueens(const Board& b, EvalInfo& ei, int color);
-void evaluateKing(const Board& b, EvalInfo& ei, int color);
+// Each term is scored from the point of view of its color, which is known at compile time
+template <int color> PackedScore evaluatePawns(const Board& b, EvalInfo& ei);
+template <int color> PackedScore evaluateKnights(const Board& b, EvalInfo& ei);
+template <int color> PackedScore evaluateBishops(const Board& b, EvalInfo& ei);
+template <int color> PackedScore evaluateRooks(const Board& b, EvalInfo& ei);
+template <int color> PackedScore evaluateQueens(const Board& b, EvalInfo& ei);
+template <int color> PackedScore evaluateKing(const Board& b, EvalInfo& ei);
 
-void evaluateSpace(const Board& b, EvalInfo& ei, int color);
-void evaluateThreats(const Board& b, EvalInfo& ei, int color);
+template <int color> PackedScore evaluateSpace(const Board& b, EvalInfo& ei);
+template <int color> PackedScore evaluateThreats(const Board& b, EvalInfo& ei);
 
-int passed(const Board& b, int sqr, const uint64_t& enemyPawns, int color);
 bool isPassed(const Board&b, int sqr, int color);
 
-int openFile(const Board& b, int file);
-
 int getPhase(const Board& b);
 
+}
+
 #endif
@@ -0,0 +1,49 @@
+// The hot code again, compiled for CPUs with BMI2 and a fast PEXT (Intel since Haswell, AMD since Zen 3)
+// Sliders are indexed with PEXT, and lsb, msb and popBit use TZCNT and LZCNT
+#define KF_ISA isaBmi2
+#undef KF_PEXT
+#define KF_PEXT 1
+
+#include "cpu.h"
+
+#if KF_X86_DISPATCH
+// Every header comes first, so that only the functions of the hot code below get the target
+// Inline functions of shared types and of the standard library stay the same in every copy
+#include "attacks.h"
+#include "bitboard.h"
+#include "board.h"
+#include "evaluate.h"
+#include "masks.h"
+#include "material.h"
+#include "move.h"
+#include "movegen.h"
+#include "movepick.h"
+#include "pawns.h"
+#include "search.h"
+#include "tt.h"
+#include "types.h"
+
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("popcnt,bmi,bmi2,lzcnt"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("popcnt,bmi,bmi2,lzcnt")
+#endif
+
+#include "attacks.cpp"
+#include "bitboard.cpp"
+#include "board.cpp"
+#include "evaluate.cpp"
+#include "material.cpp"
+#include "move.cpp"
+#include "movegen.cpp"
+#include "movepick.cpp"
+#include "pawns.cpp"
+#include "search.cpp"
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+#endif
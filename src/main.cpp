@@ -1,65 +1,141 @@
 #include "attacks.h"
+#include "bench.h"
 #include "bitboard.h"
 #include "board.h"
+#include "cpu.h"
+#include "epd.h"
 #include "evaluate.h"
 #include "masks.h"
 #include "move.h"
 #include "movegen.h"
+#include "nnue.h"
 #include "search.h"
+#include "tt.h"
 #include "uci.h"
 #include "types.h"
 
 int main()
 {
 	Board b;
+	KeyHistory history;
 	SearchInfo si;
+	initCPU();
+	initEntryPoints();
 	initKeys();
 	initAttacks();
 	initMasks();
+	initCuckoo();
+	initNNUE();
+	resizeEvalCache(defaultEvalCacheSize);
 
-	std::cout << "id name Kingfisher\n";
-	std::cout << "id author Eric Yip\n";
-	std::cout << "uciok\n";
+	// Start from the initial position so that an invalid first FEN leaves us with a usable board
+	parseFen(b, startFen);
+	history.reset(b.key);
+
+	printUCI();
+	std::cout << "info string CPU features: " << cpuFeatureString() << "\n";
+	std::cout << "info string Kernels: " << cpuKernelString() << "\n";
+
+	// The main thread only reads input, searches run on their own thread so that "stop" and "isready" are seen at once
+	std::thread searchThread;
+	auto waitForSearch = [&]() {
+		if (searchThread.joinable()) searchThread.join();
+	};
 
 	std::string input;
-	while (1) {
-		std::getline(std::cin, input);
-		if (input == "\n" || input == "") { continue; }
+	while (std::getline(std::cin, input)) {
+		Tokenizer tokens(input);
+		UciCommand command = parseCommand(tokens.next());
+		if (command == CMD_UNKNOWN) { continue; }
 
-		if (!input.compare(0, 7, "isready")) {
-			std::cout << "readyok\n";
+		if (command == CMD_ISREADY) {
+			OutputLine out;
+			out << "readyok";
+			out.send();
 			continue;
 		}
-		else if (!input.compare(0, 8, "position")) {
-			parsePosition(b,input);
+		else if (command == CMD_PONDERHIT) {
+			// The opponent played the expected move, so the ponder search becomes a normal timed search
+			si.pondering = false;
+			continue;
 		}
-		else if (!input.compare(0, 10, "ucinewgame")) {
-			parsePosition(b, "position startpos\n");
+		else if (command == CMD_STOP) {
+			si.stop = true;
+			waitForSearch();
+			continue;
 		}
-		else if (!input.compare(0, 2, "go")) {
+		else if (command == CMD_QUIT) {
+			break;
+		}
+
+		// Every other command changes state the search depends on, so we let the search finish first
+		waitForSearch();
+
+		switch (command) {
+		case CMD_POSITION:
+			parsePosition(b, history, input);
+			break;
+		case CMD_UCINEWGAME:
+			parsePosition(b, history, "position startpos");
+			break;
+		case CMD_GO:
+			si.stop = false;
+			si.history = history;
 			parseGo(b, si, input);
+			searchThread = std::thread(entryPoints->iterativeDeepening, std::ref(b), std::ref(si));
+			break;
+		case CMD_SETOPTION:
+			parseOption(si, input);
+			break;
+		case CMD_UCI:
+			printUCI();
+			break;
+		case CMD_PERFT: {
+			int depth;
+			if (parseNumber(tokens.next(), depth)) entryPoints->perft(b, depth, 0);
+			break;
 		}
-		else if (!input.compare(0, 3, "uci")) {
-			std::cout << "id name Kingfisher\n";
-			std::cout << "id author Eric Yip\n";
-			std::cout << "uciok\n";
+		case CMD_FENBENCH:
+			benchFenFile(std::string(tokens.rest()));
+			break;
+		case CMD_BENCH: {
+			int depth = benchDepth;
+			if (!tokens.empty()) parseNumber(tokens.next(), depth);
+			bench(std::min(std::max(depth, 1), (int)MAX_PLY));
+			break;
 		}
-		else if (!input.compare(0, 5, "perft")) {
-			size_t pos = input.find("perft");
-			int depth = std::stoi(input.substr(pos + 6));
-			perft(b, depth, 0);
+		case CMD_TIMEBENCH:
+			timeBench();
+			break;
+		case CMD_PAWNBENCH: {
+			int iterations = pawnBenchIterations;
+			if (!tokens.empty()) parseNumber(tokens.next(), iterations);
+			pawnBench(iterations);
+			break;
 		}
-		else if (!input.compare(0, 5, "print")) {
-			printBoard(b);
+		case CMD_LATENCYBENCH: {
+			int searches = latencyBenchSearches;
+			int moveTime = latencyBenchMoveTime;
+			if (!tokens.empty()) parseNumber(tokens.next(), searches);
+			if (!tokens.empty()) parseNumber(tokens.next(), moveTime);
+			latencyBench(searches, moveTime);
+			break;
 		}
-		else if (!input.compare(0, 5, "debug")) {
+		case CMD_PRINT:
+			printBoard(b);
+			break;
+		case CMD_DEBUG:
 			si.debug = !si.debug;
 			std::cout << "Debug mode " << ((si.debug) ? "on" : "off") << "\n";
-		}
-		else if (!input.compare(0, 4, "quit")) {
+			break;
+		default:
 			break;
 		}
 	}
 
+	// "quit" or end of input
+	si.stop = true;
+	waitForSearch();
+
 	return 0;
 }
@@ -1,5 +1,6 @@
 #include "attacks.h"
 #include "bitboard.h"
+#include "cpu.h"
 #include "masks.h"
 #include "types.h"
 
@@ -15,6 +16,13 @@ uint64_t kingRing[SQUARE_NUM];
 uint64_t bishopMoves[5248];
 uint64_t rookMoves[102400];
 
+#if KF_X86_DISPATCH
+uint64_t bishopPextMoves[5248];
+uint64_t rookPextMoves[102400];
+uint64_t* bishopPextIndex[SQUARE_NUM];
+uint64_t* rookPextIndex[SQUARE_NUM];
+#endif
+
 void initBishopBlockerMasks() {
     for (int sqr = 0; sqr < SQUARE_NUM; ++sqr) {
         uint64_t blockers = 0;
@@ -76,6 +84,34 @@ void initRookMagics() {
     }
 }
 
+#if KF_X86_DISPATCH
+KF_TARGET("bmi2")
+void initSliderPext() {
+    // Each square gets 2^n consecutive entries, n being the number of relevant blocker squares
+    uint64_t* bishopBase = bishopPextMoves;
+    uint64_t* rookBase = rookPextMoves;
+    for (int sqr = 0; sqr < SQUARE_NUM; ++sqr) {
+        bishopPextIndex[sqr] = bishopBase;
+        rookPextIndex[sqr] = rookBase;
+
+        uint64_t n = 0;
+        do {
+            bishopBase[_pext_u64(n, bishopBlockerMasks[sqr])] = getBishopAttacks(n, sqr);
+            n = (n - bishopBlockerMasks[sqr]) & bishopBlockerMasks[sqr];
+        } while (n);
+
+        n = 0;
+        do {
+            rookBase[_pext_u64(n, rookBlockerMasks[sqr])] = getRookAttacks(n, sqr);
+            n = (n - rookBlockerMasks[sqr]) & rookBlockerMasks[sqr];
+        } while (n);
+
+        bishopBase += 1ull << countBits(bishopBlockerMasks[sqr]);
+        rookBase += 1ull << countBits(rookBlockerMasks[sqr]);
+    }
+}
+#endif
+
 void initPawnAdvanceMasks() {
     for (int i = 0; i < 8; ++i) {
         uint64_t wMask = 0ull;
@@ -161,4 +197,7 @@ void initMasks() {
 
     initBishopMagics();
     initRookMagics();
+#if KF_X86_DISPATCH
+    if (cpu.bmi2) initSliderPext();
+#endif
 }
\ No newline at end of file
@@ -1,8 +1,13 @@
 #ifndef MASKS_H
 #define MASKS_H
 
+#include "cpu.h"
 #include "types.h"
 
+#if KF_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
 extern uint64_t bishopBlockerMasks[SQUARE_NUM];
 extern uint64_t rookBlockerMasks[SQUARE_NUM];
 
@@ -15,6 +20,14 @@ extern uint64_t kingRing[SQUARE_NUM];
 extern uint64_t bishopMoves[5248];
 extern uint64_t rookMoves[102400];
 
+#if KF_X86_DISPATCH
+// PEXT-indexed attack tables, used instead of the magics by the copies built with KF_PEXT
+extern uint64_t bishopPextMoves[5248];
+extern uint64_t rookPextMoves[102400];
+extern uint64_t* bishopPextIndex[SQUARE_NUM];
+extern uint64_t* rookPextIndex[SQUARE_NUM];
+#endif
+
 // A magic bitboard approach is a hashing algorithm used for indexing a attack databse for bishops and rooks
 // For more information, see https://www.chessprogramming.org/Magic_Bitboards
 // We use 'fancy' magic bitboards to eliminate redundancies and hence table size by maximizing constructive hash collisions
@@ -138,6 +151,9 @@ void initRookBlockerMasks();
 
 void initBishopMagics();
 void initRookMagics();
+#if KF_X86_DISPATCH
+void initSliderPext();
+#endif
 
 void initPawnAdvanceMasks();
 void initNeighborFileMasks();
@@ -147,7 +163,13 @@ void initKingRing();
 
 void initMasks();
 
-#define getBishopMagic(occ, sqr) *((((occ & bishopBlockerMasks[sqr]) * bishopMagics[sqr]) >> bishopMagicShifts[sqr]) + bishopMagicIndexIncrements[sqr])
-#define getRookMagic(occ, sqr) *((((occ & rookBlockerMasks[sqr]) * rookMagics[sqr]) >> rookMagicShifts[sqr]) + rookMagicIndexIncrements[sqr])
+// The slider kernel is fixed for each copy of the hot code, see KF_ISA, so that lookups stay a couple of inlined instructions
+#if KF_PEXT
+#define getBishopMagic(occ, sqr) (bishopPextIndex[sqr][_pext_u64(occ, bishopBlockerMasks[sqr])])
+#define getRookMagic(occ, sqr) (rookPextIndex[sqr][_pext_u64(occ, rookBlockerMasks[sqr])])
+#else
+#define getBishopMagic(occ, sqr) (*((((occ & bishopBlockerMasks[sqr]) * bishopMagics[sqr]) >> bishopMagicShifts[sqr]) + bishopMagicIndexIncrements[sqr]))
+#define getRookMagic(occ, sqr) (*((((occ & rookBlockerMasks[sqr]) * rookMagics[sqr]) >> rookMagicShifts[sqr]) + rookMagicIndexIncrements[sqr]))
+#endif
 
 #endif
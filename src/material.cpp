@@ -0,0 +1,130 @@
+#include "bitboard.h"
+#include "board.h"
+#include "evaluate.h"
+#include "material.h"
+#include "types.h"
+
+inline namespace KF_ISA {
+
+static int nonPawnMaterial(uint64_t materialKey, int color) {
+	int material = 0;
+	for (int type = KNIGHT; type <= QUEEN; ++type) {
+		material += materialCount(materialKey, makePiece(type, color)) * pieceValues[type][MG];
+	}
+	return material;
+}
+
+// Mating a lone king needs a rook or queen, two bishops, a bishop and a knight, or three knights
+static bool canForceMate(uint64_t materialKey, int color) {
+	const int knights = materialCount(materialKey, makePiece(KNIGHT, color));
+	const int bishops = materialCount(materialKey, makePiece(BISHOP, color));
+	const int majors = materialCount(materialKey, makePiece(ROOK, color)) + materialCount(materialKey, makePiece(QUEEN, color));
+	return majors || bishops >= 2 || (bishops && knights) || knights >= 3;
+}
+
+static void computeMaterial(uint64_t materialKey, MaterialEntry& me) {
+	me.key = materialKey;
+	me.phase = materialPhase(materialKey);
+	me.score = 0;
+	me.evaluator = nullptr;
+
+	int pawns[2];
+	int npm[2];
+	for (int color = WHITE; color <= BLACK; ++color) {
+		PackedScore score = 0;
+
+		// Step 1: Piece values
+		for (int type = PAWN; type <= QUEEN; ++type) {
+			score += materialCount(materialKey, makePiece(type, color)) * makeScore(pieceValues[type][MG], pieceValues[type][EG]);
+		}
+
+		// Step 2: Bishop pair
+		if (materialCount(materialKey, makePiece(BISHOP, color)) >= 2) {
+			score += bishopPairBonus;
+		}
+
+		me.score += (color == WHITE) ? score : -score;
+
+		pawns[color] = materialCount(materialKey, makePiece(PAWN, color));
+		npm[color] = nonPawnMaterial(materialKey, color);
+	}
+
+	// Step 3: Endgame scaling
+	// Without pawns, being up by no more than a minor piece is rarely enough to win
+	for (int color = WHITE; color <= BLACK; ++color) {
+		me.scale[color] = scaleNormal;
+		if (!pawns[color] && npm[color] - npm[!color] <= pieceValues[BISHOP][MG]) {
+			me.scale[color] = (npm[color] < pieceValues[ROOK][MG]) ? 0 : scaleDrawish;
+		}
+	}
+
+	// Step 4: Specialised evaluators
+	// Without pawns neither side can force mate with at most a minor piece or with two knights, e.g. KNNvK
+	if (!pawns[WHITE] && !pawns[BLACK] && !canForceMate(materialKey, WHITE) && !canForceMate(materialKey, BLACK)) {
+		me.evaluator = evaluateDraw;
+	}
+	// A lone king against pawnless mating material is a win, so we only need to drive it to the edge
+	// With pawns on the board the normal evaluation is needed to push them
+	else if (!pawns[WHITE] && !pawns[BLACK]) {
+		for (int strong = WHITE; strong <= BLACK; ++strong) {
+			if (npm[!strong] || !canForceMate(materialKey, strong)) continue;
+			const bool bishopKnight = (npm[strong] == pieceValues[BISHOP][MG] + pieceValues[KNIGHT][MG])
+									  && materialCount(materialKey, makePiece(BISHOP, strong)) == 1
+									  && materialCount(materialKey, makePiece(KNIGHT, strong)) == 1;
+			me.evaluator = (bishopKnight) ? evaluateBishopKnight : evaluateLonelyKing;
+		}
+	}
+}
+
+const MaterialEntry& probeMaterial(MaterialTable& table, const Board& b) {
+	MaterialEntry& me = table.entries[(b.materialKey * 0x9e3779b97f4a7c15ull) >> (64 - materialHashBits)];
+	if (me.key != b.materialKey) computeMaterial(b.materialKey, me);
+	return me;
+}
+
+int evaluateDraw(const Board&, const MaterialEntry&) {
+	return 0;
+}
+
+static inline int centreDistance(int sqr) {
+	const int file = sqr % 8;
+	const int rank = sqr / 8;
+	return std::max(std::max(3 - file, file - 4), std::max(3 - rank, rank - 4));
+}
+
+static inline int squareDistance(int a, int b) {
+	return std::max(abs(a % 8 - b % 8), abs(a / 8 - b / 8));
+}
+
+static inline int strongSide(const Board& b) {
+	return (b.colors[BLACK] & ~b.pieces[KING]) ? BLACK : WHITE;
+}
+
+int evaluateLonelyKing(const Board& b, const MaterialEntry& me) {
+	const int strong = strongSide(b);
+	const int strongKing = b.kingSquares[strong];
+	const int weakKing = b.kingSquares[!strong];
+
+	int eval = (strong == WHITE) ? egScore(me.score) : -egScore(me.score);
+	eval += centreDistance(weakKing) * lonelyKingEdgeBonus;
+	eval += (7 - squareDistance(strongKing, weakKing)) * lonelyKingDistanceBonus;
+	return (strong == WHITE) ? eval : -eval;
+}
+
+int evaluateBishopKnight(const Board& b, const MaterialEntry& me) {
+	const int strong = strongSide(b);
+	const int strongKing = b.kingSquares[strong];
+	const int weakKing = b.kingSquares[!strong];
+
+	// Mate is only possible in a corner of the bishop's colour, driving the king to any edge can end in the wrong corner
+	const bool darkBishop = !squareColor(lsb(b.pieces[BISHOP] & b.colors[strong]));
+	const int cornerDistance = (darkBishop) ? std::min(squareDistance(weakKing, A1), squareDistance(weakKing, H8))
+											: std::min(squareDistance(weakKing, A8), squareDistance(weakKing, H1));
+
+	int eval = (strong == WHITE) ? egScore(me.score) : -egScore(me.score);
+	eval += (7 - cornerDistance) * bishopKnightCornerBonus;
+	eval += (7 - squareDistance(strongKing, weakKing)) * lonelyKingDistanceBonus;
+	return (strong == WHITE) ? eval : -eval;
+}
+
+}
@@ -0,0 +1,74 @@
+#ifndef MATERIAL_H
+#define MATERIAL_H
+
+#include "cpu.h"
+#include "types.h"
+
+// The material key stores the number of pieces of each kind in 4 bits, so it describes the material exactly
+// Kings are not counted, and the entry for EMPTY lets captures update the key without a branch
+struct MaterialKeyTable {
+	uint64_t increments[EMPTY + 1];
+	constexpr MaterialKeyTable() : increments() {
+		for (int p = W_PAWN; p <= B_KING; ++p) {
+			increments[p] = (p % 6 == KING) ? 0 : 1ull << (4 * p);
+		}
+	}
+	constexpr uint64_t operator[](int piece) const { return increments[piece]; }
+};
+
+static constexpr MaterialKeyTable materialKeyIncrements;
+
+static constexpr int materialCount(uint64_t materialKey, int piece) {
+	return (materialKey >> (4 * piece)) & 0xf;
+}
+
+static constexpr int materialHashBits = 13;
+static constexpr int materialHashEntries = 1 << materialHashBits;
+
+static constexpr int scaleNormal = 64;
+static constexpr int scaleDrawish = 16;  // No pawns and less than a minor piece ahead, e.g. KRvKB
+
+static constexpr int lonelyKingEdgeBonus = 40;  // Per step the lone king is pushed away from the centre
+static constexpr int lonelyKingDistanceBonus = 20;  // Per step the kings are closer together
+static constexpr int bishopKnightCornerBonus = 40;  // Per step the lone king is closer to a corner of the bishop's colour
+
+struct MaterialEntry;
+
+// Evaluates a position from white's point of view when the material allows a simpler evaluation
+typedef int (*EndgameEvaluator)(const Board& b, const MaterialEntry& me);
+
+struct MaterialEntry {
+	uint64_t key = ~0ull;  // Never a valid material key, as counts are at most 10
+	int phase = 0;
+	PackedScore score = 0;  // Piece values and the bishop pair from white's point of view
+	int scale[2] = { scaleNormal, scaleNormal };  // Applied to the endgame score when white or black is ahead
+	EndgameEvaluator evaluator = nullptr;
+};
+
+// Entries are written without locks, so every search owns its table instead of sharing one
+struct MaterialTable {
+	std::vector<MaterialEntry> entries = std::vector<MaterialEntry>(materialHashEntries);
+};
+
+static inline int materialPhase(uint64_t materialKey) {
+	// Game phase is normalized between 24 (middlegame) and 0 (endgame)
+	// We do not consider pawns in calculating game phase
+	int phase = 0;
+	for (int color = WHITE; color <= BLACK; ++color) {
+		phase += materialCount(materialKey, makePiece(KNIGHT, color)) + materialCount(materialKey, makePiece(BISHOP, color))
+				 + 2 * materialCount(materialKey, makePiece(ROOK, color)) + 4 * materialCount(materialKey, makePiece(QUEEN, color));
+	}
+	return std::min(phase, 24);
+}
+
+inline namespace KF_ISA {
+
+const MaterialEntry& probeMaterial(MaterialTable& table, const Board& b);
+
+int evaluateDraw(const Board& b, const MaterialEntry& me);
+int evaluateLonelyKing(const Board& b, const MaterialEntry& me);
+int evaluateBishopKnight(const Board& b, const MaterialEntry& me);
+
+}
+
+#endif
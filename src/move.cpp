@@ -2,12 +2,19 @@
 #include "bitboard.h"
 #include "board.h"
 #include "evaluate.h"
+#include "material.h"
 #include "move.h"
 #include "types.h"
 
+inline namespace KF_ISA {
+
 Undo makeMove(Board& b, const uint16_t& m) {
 	if (!m) return Undo();
 	assert(validSquare(moveFrom(m)) && validSquare(moveTo(m)));
+#if KF_ATTACK_MAPS
+	AttackUpdate update;
+	beginAttackUpdate(b, m, b.turn, update);
+#endif
 	Undo u;
 	switch (moveFlag(m)) {
 	default:  // Promotion
@@ -25,7 +32,9 @@ Undo makeMove(Board& b, const uint16_t& m) {
 	}
 	b.turn = !b.turn;
 	if (b.epSquare == u.epSquare) b.epSquare = -1;
-	b.history[++b.moveNum] = b.key;
+#if KF_ATTACK_MAPS
+	finishAttackUpdate(b, update);
+#endif
 	return u;
 }
 
@@ -39,13 +48,17 @@ Undo makeNormalMove(Board& b, const uint16_t& m) {
 	const int toType = pieceType(toPiece);	
 
 	// Save board state in undo object
-	Undo u(b.key, b.epSquare, b.castlingRights, b.fiftyMove, b.psqt[MG], b.psqt[EG], toPiece);
+	Undo u(b.key, b.materialKey, b.pawnKey, b.epSquare, b.castlingRights, b.fiftyMove, b.psqt, toPiece);
 
 	b.fiftyMove = (fromType == PAWN || toPiece != EMPTY) ? 0 : b.fiftyMove + 1;
 
 	b.squares[moveFrom(m)] = EMPTY;
 	b.squares[moveTo(m)] = fromPiece;
 
+	if (toPiece != EMPTY) removePiece(b, toPiece, moveTo(m));
+	movePiece(b, fromPiece, moveFrom(m), moveTo(m));
+	if (fromType == KING) b.kingSquares[b.turn] = moveTo(m);
+
 	b.pieces[fromType] ^= (1ull << moveFrom(m)) ^ (1ull << moveTo(m));
 	b.colors[b.turn] ^= (1ull << moveFrom(m)) ^ (1ull << moveTo(m));
 	if (toPiece != EMPTY) {
@@ -57,6 +70,9 @@ Undo makeNormalMove(Board& b, const uint16_t& m) {
 	b.key ^= pieceKeys[fromPiece][moveFrom(m)] ^ pieceKeys[fromPiece][moveTo(m)];
 	if (toPiece != EMPTY) b.key ^= pieceKeys[toPiece][moveTo(m)];
 	b.key ^= turnKey;
+	b.materialKey -= materialKeyIncrements[toPiece];
+	if (fromType == PAWN) b.pawnKey ^= pieceKeys[fromPiece][moveFrom(m)] ^ pieceKeys[fromPiece][moveTo(m)];
+	if (toType == PAWN) b.pawnKey ^= pieceKeys[toPiece][moveTo(m)];
 
 	// Update en passant square
 	if (fromType == PAWN && (moveFrom(m) ^ moveTo(m)) == 16) {
@@ -68,14 +84,10 @@ Undo makeNormalMove(Board& b, const uint16_t& m) {
 	if (b.epSquare == u.epSquare) b.epSquare = -1;
 
 	// Update piece-square tables
-	int mgPSQT = psqtScore(fromType, psqtSquare(moveTo(m), b.turn), MG) - psqtScore(fromType, psqtSquare(moveFrom(m), b.turn), MG);
-	if (toPiece != EMPTY) mgPSQT += psqtScore(toType, psqtSquare(moveTo(m), !b.turn), MG);
-	b.psqt[MG] += (b.turn == WHITE) ? mgPSQT : -mgPSQT;
-
-	int egPSQT = psqtScore(fromType, psqtSquare(moveTo(m), b.turn), EG) - psqtScore(fromType, psqtSquare(moveFrom(m), b.turn), EG);
-	if (toPiece != EMPTY) egPSQT += psqtScore(toType, psqtSquare(moveTo(m), !b.turn), EG);
-	b.psqt[EG] += (b.turn == WHITE) ? egPSQT : -egPSQT;
+	b.psqt += pieceSquareTable[fromPiece][moveTo(m)] - pieceSquareTable[fromPiece][moveFrom(m)] - pieceSquareTable[toPiece][moveTo(m)];
 
+	b.phase -= pieceMaterial.phase[toPiece];
+	b.nonPawnMaterial[!b.turn] -= pieceMaterial.nonPawn[toPiece];
 
 	updateCastleRights(b, m);
 
@@ -91,7 +103,7 @@ Undo makeEnPassantMove(Board& b, const uint16_t& m) {
 	assert(b.squares[moveTo(m)] == EMPTY);
 	assert(b.squares[epSquare] == epPiece);
 
-	Undo u(b.key, b.epSquare, b.castlingRights, b.fiftyMove, b.psqt[MG], b.psqt[EG], epPiece);
+	Undo u(b.key, b.materialKey, b.pawnKey, b.epSquare, b.castlingRights, b.fiftyMove, b.psqt, epPiece);
 
 	b.fiftyMove = 0;
 
@@ -99,6 +111,9 @@ Undo makeEnPassantMove(Board& b, const uint16_t& m) {
 	b.squares[moveTo(m)] = fromPiece;
 	b.squares[epSquare] = EMPTY;
 
+	movePiece(b, fromPiece, moveFrom(m), moveTo(m));
+	removePiece(b, epPiece, epSquare);
+
 	b.pieces[PAWN] ^= (1ull << moveFrom(m)) ^ (1ull << moveTo(m));
 	b.colors[b.turn] ^= (1ull << moveFrom(m)) ^ (1ull << moveTo(m));
 
@@ -109,12 +124,10 @@ Undo makeEnPassantMove(Board& b, const uint16_t& m) {
 
 	b.key ^= pieceKeys[fromPiece][moveFrom(m)] ^ pieceKeys[fromPiece][moveTo(m)] ^ pieceKeys[epPiece][epSquare];
 	b.key ^= turnKey;
+	b.materialKey -= materialKeyIncrements[epPiece];
+	b.pawnKey ^= pieceKeys[fromPiece][moveFrom(m)] ^ pieceKeys[fromPiece][moveTo(m)] ^ pieceKeys[epPiece][epSquare];
 
-	int mgPSQT = psqtScore(PAWN, psqtSquare(moveTo(m), b.turn), MG) - psqtScore(PAWN, psqtSquare(moveFrom(m), b.turn), MG) + psqtScore(PAWN, psqtSquare(epSquare, !b.turn), MG);
-	b.psqt[MG] += (b.turn == WHITE) ? mgPSQT : -mgPSQT;
-
-	int egPSQT = psqtScore(PAWN, psqtSquare(moveTo(m), b.turn), EG) - psqtScore(PAWN, psqtSquare(moveFrom(m), b.turn), EG) + psqtScore(PAWN, psqtSquare(epSquare, !b.turn), EG);
-	b.psqt[EG] += (b.turn == WHITE) ? egPSQT : -egPSQT;
+	b.psqt += pieceSquareTable[fromPiece][moveTo(m)] - pieceSquareTable[fromPiece][moveFrom(m)] - pieceSquareTable[epPiece][epSquare];
 
 	return u;
 }
@@ -146,13 +159,17 @@ Undo makePromotionMove(Board& b, const uint16_t& m) {
 	assert(promotionPiece != EMPTY);
 
 	// Save board state in undo object
-	Undo u(b.key, b.epSquare, b.castlingRights, b.fiftyMove, b.psqt[MG], b.psqt[EG], toPiece);
+	Undo u(b.key, b.materialKey, b.pawnKey, b.epSquare, b.castlingRights, b.fiftyMove, b.psqt, toPiece);
 
 	b.fiftyMove = 0;
 
 	b.squares[moveFrom(m)] = EMPTY;
 	b.squares[moveTo(m)] = promotionPiece;
 
+	if (toPiece != EMPTY) removePiece(b, toPiece, moveTo(m));
+	removePiece(b, fromPiece, moveFrom(m));
+	addPiece(b, promotionPiece, moveTo(m));
+
 	b.pieces[fromType] ^= (1ull << moveFrom(m));
 	b.pieces[pieceType(promotionPiece)] ^= (1ull << moveTo(m));
 	b.colors[b.turn] ^= (1ull << moveFrom(m)) ^ (1ull << moveTo(m));
@@ -165,14 +182,15 @@ Undo makePromotionMove(Board& b, const uint16_t& m) {
 	b.key ^= pieceKeys[fromPiece][moveFrom(m)] ^ pieceKeys[promotionPiece][moveTo(m)];
 	if (toPiece != EMPTY) b.key ^= pieceKeys[toPiece][moveTo(m)];
 	b.key ^= turnKey;
+	b.materialKey += materialKeyIncrements[promotionPiece] - materialKeyIncrements[fromPiece] - materialKeyIncrements[toPiece];
+	b.pawnKey ^= pieceKeys[fromPiece][moveFrom(m)];
+	if (toType == PAWN) b.pawnKey ^= pieceKeys[toPiece][moveTo(m)];
 
-	int mgPSQT = psqtScore(pieceType(promotionPiece), psqtSquare(moveTo(m), b.turn), MG) - psqtScore(PAWN, psqtSquare(moveFrom(m), b.turn), MG);
-	if (toPiece != EMPTY) mgPSQT += psqtScore(toType, psqtSquare(moveTo(m), !b.turn), MG);
-	b.psqt[MG] += (b.turn == WHITE) ? mgPSQT : -mgPSQT;
+	b.psqt += pieceSquareTable[promotionPiece][moveTo(m)] - pieceSquareTable[fromPiece][moveFrom(m)] - pieceSquareTable[toPiece][moveTo(m)];
 
-	int egPSQT = psqtScore(pieceType(promotionPiece), psqtSquare(moveTo(m), b.turn), EG) - psqtScore(PAWN, psqtSquare(moveFrom(m), b.turn), EG);
-	if (toPiece != EMPTY) egPSQT += psqtScore(toType, psqtSquare(moveTo(m), !b.turn), EG);
-	b.psqt[EG] += (b.turn == WHITE) ? egPSQT : -egPSQT;
+	b.phase += pieceMaterial.phase[promotionPiece] - pieceMaterial.phase[toPiece];
+	b.nonPawnMaterial[b.turn] += pieceMaterial.nonPawn[promotionPiece];
+	b.nonPawnMaterial[!b.turn] -= pieceMaterial.nonPawn[toPiece];
 
 	return u;
 }
@@ -189,7 +207,7 @@ Undo makeCastleMove(Board& b, const uint16_t& m) {
 	assert(fromType == KING);
 
 	// Save board state in undo object
-	Undo u(b.key, b.epSquare, b.castlingRights, b.fiftyMove, b.psqt[MG], b.psqt[EG], EMPTY);
+	Undo u(b.key, b.materialKey, b.pawnKey, b.epSquare, b.castlingRights, b.fiftyMove, b.psqt, EMPTY);
 
 	b.fiftyMove += 1;
 
@@ -198,6 +216,10 @@ Undo makeCastleMove(Board& b, const uint16_t& m) {
 	b.squares[fromRook] = EMPTY;
 	b.squares[toRook] = rookPiece;
 
+	movePiece(b, fromPiece, moveFrom(m), moveTo(m));
+	movePiece(b, rookPiece, fromRook, toRook);
+	b.kingSquares[b.turn] = moveTo(m);
+
 	b.pieces[KING] ^= (1ull << moveFrom(m)) ^ (1ull << moveTo(m));
 	b.pieces[ROOK] ^= (1ull << fromRook) ^ (1ull << toRook);
 	b.colors[b.turn] ^= (1ull << moveFrom(m)) ^ (1ull << moveTo(m)) ^ (1ull << fromRook) ^ (1ull << toRook);
@@ -209,24 +231,26 @@ Undo makeCastleMove(Board& b, const uint16_t& m) {
 
 	updateCastleRights(b, m);
 
-	int mgPSQT = psqtScore(ROOK, psqtSquare(toRook, b.turn), MG) - psqtScore(ROOK, psqtSquare(fromRook, b.turn), MG);
-	b.psqt[MG] += (b.turn == WHITE) ? mgPSQT : -mgPSQT;
-
-	int egPSQT = psqtScore(ROOK, psqtSquare(toRook, b.turn), EG) - psqtScore(ROOK, psqtSquare(fromRook, b.turn), EG);
-	b.psqt[EG] += (b.turn == WHITE) ? egPSQT : -egPSQT;
+	b.psqt += pieceSquareTable[rookPiece][toRook] - pieceSquareTable[rookPiece][fromRook];
 
 	return u;
 }
 
 void undoMove(Board& b, const uint16_t& m, const Undo& u) {
+#if KF_ATTACK_MAPS
+	AttackUpdate update;
+	beginAttackUpdate(b, m, !b.turn, update);
+#endif
 	b.turn = !b.turn;
 	b.key = u.key;
+	b.materialKey = u.materialKey;
+	b.pawnKey = u.pawnKey;
 	b.epSquare = u.epSquare;
 	b.castlingRights = u.castlingRights;
-	b.psqt[MG] = u.psqt[MG];
-	b.psqt[EG] = u.psqt[EG];
+	b.psqt = u.psqt;
 	b.fiftyMove = u.fiftyMove;
-	b.history[b.moveNum--] = 0ull;
+	b.phase += pieceMaterial.phase[u.capturedPiece];
+	b.nonPawnMaterial[!b.turn] += pieceMaterial.nonPawn[u.capturedPiece];
 
 	assert(validSquare(moveFrom(m)) && validSquare(moveTo(m)));
 
@@ -237,6 +261,9 @@ void undoMove(Board& b, const uint16_t& m, const Undo& u) {
 		b.squares[moveTo(m)] = EMPTY;
 		b.squares[epSquare] = u.capturedPiece;
 
+		movePiece(b, b.squares[moveFrom(m)], moveTo(m), moveFrom(m));
+		addPiece(b, u.capturedPiece, epSquare);
+
 		b.pieces[PAWN] ^= (1ull << moveFrom(m)) ^ (1ull << moveTo(m));
 		b.colors[b.turn] ^= (1ull << moveFrom(m)) ^ (1ull << moveTo(m));
 
@@ -251,6 +278,12 @@ void undoMove(Board& b, const uint16_t& m, const Undo& u) {
 
 		int promotionPiece = makePiece(moveFlag(m) - 2, b.turn);
 
+		removePiece(b, promotionPiece, moveTo(m));
+		b.phase -= pieceMaterial.phase[promotionPiece];
+		b.nonPawnMaterial[b.turn] -= pieceMaterial.nonPawn[promotionPiece];
+		addPiece(b, b.squares[moveFrom(m)], moveFrom(m));
+		if (u.capturedPiece != EMPTY) addPiece(b, u.capturedPiece, moveTo(m));
+
 		b.pieces[PAWN] ^= (1ull << moveFrom(m));
 		b.pieces[pieceType(promotionPiece)] ^= (1ull << moveTo(m));
 		b.colors[b.turn] ^= (1ull << moveFrom(m)) ^ (1ull << moveTo(m));
@@ -268,6 +301,10 @@ void undoMove(Board& b, const uint16_t& m, const Undo& u) {
 		b.squares[fromRook] = b.squares[toRook];
 		b.squares[toRook] = EMPTY;
 
+		movePiece(b, b.squares[moveFrom(m)], moveTo(m), moveFrom(m));
+		movePiece(b, b.squares[fromRook], toRook, fromRook);
+		b.kingSquares[b.turn] = moveFrom(m);
+
 		b.pieces[KING] ^= (1ull << moveFrom(m)) ^ (1ull << moveTo(m));
 		b.pieces[ROOK] ^= (1ull << fromRook) ^ (1ull << toRook);
 		b.colors[b.turn] ^= (1ull << moveFrom(m)) ^ (1ull << moveTo(m)) ^ (1ull << fromRook) ^ (1ull << toRook);
@@ -279,6 +316,10 @@ void undoMove(Board& b, const uint16_t& m, const Undo& u) {
 		const int fromType = pieceType(b.squares[moveFrom(m)]);
 		const int toType = pieceType(b.squares[moveTo(m)]);
 
+		movePiece(b, b.squares[moveFrom(m)], moveTo(m), moveFrom(m));
+		if (u.capturedPiece != EMPTY) addPiece(b, u.capturedPiece, moveTo(m));
+		if (fromType == KING) b.kingSquares[b.turn] = moveFrom(m);
+
 		b.pieces[fromType] ^= (1ull << moveFrom(m)) ^ (1ull << moveTo(m));
 		b.colors[b.turn] ^= (1ull << moveFrom(m)) ^ (1ull << moveTo(m));
 		if (u.capturedPiece != EMPTY) {
@@ -288,14 +329,19 @@ void undoMove(Board& b, const uint16_t& m, const Undo& u) {
 	}
 
 	b.colors[NO_COLOR] = ~(b.colors[b.turn] | b.colors[!b.turn]);
+#if KF_ATTACK_MAPS
+	finishAttackUpdate(b, update);
+#endif
 }
 
 Undo makeNullMove(Board& b) {
-	Undo u(b.key, b.epSquare, b.castlingRights, b.fiftyMove, b.psqt[MG], b.psqt[EG], EMPTY);
+	Undo u(b.key, b.materialKey, b.pawnKey, b.epSquare, b.castlingRights, b.fiftyMove, b.psqt, EMPTY);
 	b.turn = !b.turn;
 	b.key ^= turnKey;
 	if (b.epSquare != -1) b.key ^= epKeys[b.epSquare % 8];
 	b.epSquare = -1;
+	// Positions before a null move must not count as repetitions, so the counter starts again
+	b.fiftyMove = 0;
 	return u;
 }
 
@@ -303,6 +349,7 @@ void undoNullMove(Board& b, const Undo& u) {
 	b.turn = !b.turn;
 	b.key = u.key;
 	b.epSquare = u.epSquare;
+	b.fiftyMove = u.fiftyMove;
 }
 
 void updateCastleRights(Board& b, const uint16_t& m) {
@@ -480,4 +527,6 @@ bool moveIsPsuedoLegal(const Board& b, const uint16_t& m) {
 	}
 
 	return false;
+}
+
 }
\ No newline at end of file
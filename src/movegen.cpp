@@ -6,6 +6,8 @@
 #include "movegen.h"
 #include "types.h"
 
+inline namespace KF_ISA {
+
 void addPawnMoves(std::vector<uint16_t>& moves, uint64_t bb, const int shift) {
 	while (bb) {
 		int sqr = popBit(bb);
@@ -173,4 +175,6 @@ std::vector<uint16_t> genNoisyMoves(const Board& b) {
 	genQueenMoves(b, noisyMoves, true);
 	genKingMoves(b, noisyMoves, true);
 	return noisyMoves;
+}
+
 }
\ No newline at end of file
@@ -1,8 +1,11 @@
 #ifndef MOVEGEN_H
 #define MOVEGEN_H
 
+#include "cpu.h"
 #include "types.h"
 
+inline namespace KF_ISA {
+
 void addPawnMoves(std::vector<uint16_t>& moves, uint64_t bb, const int shift);
 void addPieceMoves(std::vector<uint16_t>& moves, uint64_t bb, const int from);
 
@@ -16,4 +19,6 @@ void genKingMoves(const Board& b, std::vector<uint16_t>& moves, bool noisyOnly);
 std::vector<uint16_t> genAllMoves(const Board& b);
 std::vector<uint16_t> genNoisyMoves(const Board& b);
 
+}
+
 #endif
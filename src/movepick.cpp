@@ -7,7 +7,9 @@
 #include "search.h"
 #include "types.h"
 
-uint16_t pickNextMove(const Board& b, const uint16_t& hashMove, int& stage, std::vector<ScoredMove>& moves, const int& ply, int& movesTried) {
+inline namespace KF_ISA {
+
+uint16_t pickNextMove(const Board& b, const uint16_t& hashMove, int& stage, std::vector<ScoredMove>& moves, const int& ply, int& movesTried, const SearchThread& thread) {
 
 	switch (stage) {
 		
@@ -31,7 +33,7 @@ uint16_t pickNextMove(const Board& b, const uint16_t& hashMove, int& stage, std:
 			bool ageHistory = false;
 
 			auto unscoredMoves = genAllMoves(b);
-			moves = scoreMoves(b, unscoredMoves, ply, hashMove);
+			moves = scoreMoves(b, unscoredMoves, ply, hashMove, thread);
 			std::sort(moves.begin(), moves.end(), [](const auto& a, const auto& b) { return a.score > b.score; });
 
 			[[fallthrough]];
@@ -64,4 +66,6 @@ uint16_t pickNextMove(const Board& b, const uint16_t& hashMove, int& stage, std:
 
 	}
 
+}
+
 }
\ No newline at end of file
@@ -1,10 +1,15 @@
 #ifndef MOVEPICK_H
 #define MOVEPICK_H
 
+#include "cpu.h"
 #include "types.h"
 
 enum MovePickStage { START_PICK, TT_PICK, NORMAL_GEN, NORMAL_PICK, NO_MOVES_LEFT };
 
-uint16_t pickNextMove(const Board& b, const uint16_t& hashMove, int& stage, std::vector<ScoredMove>& moves, const int& ply, int& movesTried);
+inline namespace KF_ISA {
+
+uint16_t pickNextMove(const Board& b, const uint16_t& hashMove, int& stage, std::vector<ScoredMove>& moves, const int& ply, int& movesTried, const SearchThread& thread);
+
+}
 
 #endif
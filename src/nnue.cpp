@@ -0,0 +1,414 @@
+#include <memory>
+
+#include "bitboard.h"
+#include "board.h"
+#include "cpu.h"
+#include "epd.h"
+#include "move.h"
+#include "nnue.h"
+#include "output.h"
+#include "types.h"
+
+#if KF_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+#if KF_EMBEDDED_NET
+asm(".section .rodata\n"
+	".balign 64\n"
+	".global kfEmbeddedNet\n"
+	"kfEmbeddedNet:\n"
+	".incbin \"" KF_EVAL_FILE "\"\n"
+	".global kfEmbeddedNetEnd\n"
+	"kfEmbeddedNetEnd:\n"
+	".previous\n");
+extern "C" const char kfEmbeddedNet[];
+extern "C" const char kfEmbeddedNetEnd[];
+#endif
+
+bool useNNUE = false;
+std::string evalFile = defaultEvalFile;
+
+// Parameters in the order of the file, the weights of each output neuron are contiguous
+struct Network {
+	std::vector<int16_t> featureBiases;
+	std::vector<int16_t> featureWeights;
+	int32_t hidden1Biases[nnueHidden];
+	int8_t hidden1Weights[nnueHidden * 2 * nnueHalfDimensions];
+	int32_t hidden2Biases[nnueHidden];
+	int8_t hidden2Weights[nnueHidden * nnueHidden];
+	int32_t outputBias[1];
+	int8_t outputWeights[nnueHidden];
+	std::string description;
+};
+
+static Network net;
+static std::string loadedFile;
+
+// Adds and subtracts rows of feature weights to a row of 256 sums in one pass, keeping each chunk in registers
+typedef void (*AccumulateKernel)(int16_t* acc, const int16_t* previous, const int16_t* const* added, int addedCount,
+								 const int16_t* const* removed, int removedCount);
+
+// Dot products of unsigned 8 bit inputs with signed 8 bit weights, plus biases
+typedef void (*AffineKernel)(const uint8_t* input, int inputs, const int8_t* weights, const int32_t* biases, int32_t* output, int outputs);
+
+static void accumulateGeneric(int16_t* acc, const int16_t* previous, const int16_t* const* added, int addedCount,
+							  const int16_t* const* removed, int removedCount) {
+	for (int i = 0; i < nnueHalfDimensions; ++i) {
+		int16_t sum = previous[i];
+		for (int j = 0; j < addedCount; ++j) sum += added[j][i];
+		for (int j = 0; j < removedCount; ++j) sum -= removed[j][i];
+		acc[i] = sum;
+	}
+}
+
+static void affineGeneric(const uint8_t* input, int inputs, const int8_t* weights, const int32_t* biases, int32_t* output, int outputs) {
+	for (int o = 0; o < outputs; ++o) {
+		int32_t sum = biases[o];
+		for (int i = 0; i < inputs; ++i) sum += input[i] * weights[o * inputs + i];
+		output[o] = sum;
+	}
+}
+
+#if KF_X86_DISPATCH
+static void accumulateSSE2(int16_t* acc, const int16_t* previous, const int16_t* const* added, int addedCount,
+						   const int16_t* const* removed, int removedCount) {
+	for (int i = 0; i < nnueHalfDimensions; i += 8) {
+		__m128i sum = _mm_loadu_si128((const __m128i*)(previous + i));
+		for (int j = 0; j < addedCount; ++j) sum = _mm_add_epi16(sum, _mm_loadu_si128((const __m128i*)(added[j] + i)));
+		for (int j = 0; j < removedCount; ++j) sum = _mm_sub_epi16(sum, _mm_loadu_si128((const __m128i*)(removed[j] + i)));
+		_mm_storeu_si128((__m128i*)(acc + i), sum);
+	}
+}
+
+static void affineSSE2(const uint8_t* input, int inputs, const int8_t* weights, const int32_t* biases, int32_t* output, int outputs) {
+	// SSE2 has no unsigned by signed byte multiply, so both sides are widened to 16 bits first
+	const __m128i zero = _mm_setzero_si128();
+	for (int o = 0; o < outputs; ++o) {
+		const int8_t* row = weights + o * inputs;
+		__m128i sum = zero;
+		for (int i = 0; i < inputs; i += 16) {
+			const __m128i in = _mm_loadu_si128((const __m128i*)(input + i));
+			const __m128i w = _mm_loadu_si128((const __m128i*)(row + i));
+			const __m128i wLow = _mm_srai_epi16(_mm_unpacklo_epi8(w, w), 8);
+			const __m128i wHigh = _mm_srai_epi16(_mm_unpackhi_epi8(w, w), 8);
+			sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_unpacklo_epi8(in, zero), wLow));
+			sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_unpackhi_epi8(in, zero), wHigh));
+		}
+		sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4e));
+		sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xb1));
+		output[o] = biases[o] + _mm_cvtsi128_si32(sum);
+	}
+}
+
+KF_TARGET("avx2")
+static void accumulateAVX2(int16_t* acc, const int16_t* previous, const int16_t* const* added, int addedCount,
+						   const int16_t* const* removed, int removedCount) {
+	for (int i = 0; i < nnueHalfDimensions; i += 16) {
+		__m256i sum = _mm256_loadu_si256((const __m256i*)(previous + i));
+		for (int j = 0; j < addedCount; ++j) sum = _mm256_add_epi16(sum, _mm256_loadu_si256((const __m256i*)(added[j] + i)));
+		for (int j = 0; j < removedCount; ++j) sum = _mm256_sub_epi16(sum, _mm256_loadu_si256((const __m256i*)(removed[j] + i)));
+		_mm256_storeu_si256((__m256i*)(acc + i), sum);
+	}
+}
+
+KF_TARGET("avx2")
+static inline int32_t horizontalSum(__m256i sum) {
+	__m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+	half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0x4e));
+	half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0xb1));
+	return _mm_cvtsi128_si32(half);
+}
+
+KF_TARGET("avx2")
+static void affineAVX2(const uint8_t* input, int inputs, const int8_t* weights, const int32_t* biases, int32_t* output, int outputs) {
+	// Inputs are at most 127, so the pairwise 16 bit sums of maddubs cannot saturate
+	const __m256i ones = _mm256_set1_epi16(1);
+	for (int o = 0; o < outputs; ++o) {
+		const int8_t* row = weights + o * inputs;
+		__m256i sum = _mm256_setzero_si256();
+		for (int i = 0; i < inputs; i += 32) {
+			const __m256i products = _mm256_maddubs_epi16(_mm256_loadu_si256((const __m256i*)(input + i)),
+														  _mm256_loadu_si256((const __m256i*)(row + i)));
+			sum = _mm256_add_epi32(sum, _mm256_madd_epi16(products, ones));
+		}
+		output[o] = biases[o] + horizontalSum(sum);
+	}
+}
+
+KF_TARGET("avx512f,avx512bw")
+static void accumulateAVX512(int16_t* acc, const int16_t* previous, const int16_t* const* added, int addedCount,
+							 const int16_t* const* removed, int removedCount) {
+	for (int i = 0; i < nnueHalfDimensions; i += 32) {
+		__m512i sum = _mm512_loadu_si512(previous + i);
+		for (int j = 0; j < addedCount; ++j) sum = _mm512_add_epi16(sum, _mm512_loadu_si512(added[j] + i));
+		for (int j = 0; j < removedCount; ++j) sum = _mm512_sub_epi16(sum, _mm512_loadu_si512(removed[j] + i));
+		_mm512_storeu_si512(acc + i, sum);
+	}
+}
+
+KF_TARGET("avx512f,avx512bw")
+static void affineAVX512(const uint8_t* input, int inputs, const int8_t* weights, const int32_t* biases, int32_t* output, int outputs) {
+	// The hidden layers only have 32 inputs, which do not fill a 512 bit register
+	if (inputs % 64) {
+		affineAVX2(input, inputs, weights, biases, output, outputs);
+		return;
+	}
+	const __m512i ones = _mm512_set1_epi16(1);
+	for (int o = 0; o < outputs; ++o) {
+		const int8_t* row = weights + o * inputs;
+		__m512i sum = _mm512_setzero_si512();
+		for (int i = 0; i < inputs; i += 64) {
+			const __m512i products = _mm512_maddubs_epi16(_mm512_loadu_si512(input + i), _mm512_loadu_si512(row + i));
+			sum = _mm512_add_epi32(sum, _mm512_madd_epi16(products, ones));
+		}
+		// Summed through memory, as the lane extract intrinsics trip a false uninitialized warning in GCC 12 headers
+		alignas(64) int32_t lanes[16];
+		_mm512_store_si512(lanes, sum);
+		int32_t total = biases[o];
+		for (int i = 0; i < 16; ++i) total += lanes[i];
+		output[o] = total;
+	}
+}
+#endif
+
+static AccumulateKernel accumulate = accumulateGeneric;
+static AffineKernel affine = affineGeneric;
+
+void initNNUE() {
+#if KF_X86_DISPATCH
+	switch (cpu.simd) {
+	case SIMD_AVX512:
+		accumulate = accumulateAVX512;
+		affine = affineAVX512;
+		break;
+	case SIMD_AVX2:
+		accumulate = accumulateAVX2;
+		affine = affineAVX2;
+		break;
+	case SIMD_SSE2:
+		accumulate = accumulateSSE2;
+		affine = affineSSE2;
+		break;
+	}
+#endif
+}
+
+// Reads little-endian values front to back, any read past the end marks the whole file as invalid
+struct NetworkReader {
+	const char* cur;
+	const char* end;
+	bool ok = true;
+
+	template <typename T>
+	void read(T* values, size_t count) {
+		const size_t bytes = count * sizeof(T);
+		if (!ok || (size_t)(end - cur) < bytes) {
+			ok = false;
+			return;
+		}
+		memcpy(values, cur, bytes);
+		cur += bytes;
+	}
+
+	uint32_t read32() {
+		uint32_t value = 0;
+		read(&value, 1);
+		return value;
+	}
+};
+
+static bool parseNetwork(const char* data, size_t size) {
+	NetworkReader reader{ data, data + size };
+	auto candidate = std::make_unique<Network>();
+
+	// Step 1: Header
+	// The architecture hashes are not checked, the exact file size rules out other architectures
+	if (reader.read32() != nnueVersion) return false;
+	reader.read32();
+	const uint32_t descriptionLength = reader.read32();
+	if (!reader.ok || descriptionLength > size) return false;
+	candidate->description.resize(descriptionLength);
+	reader.read(candidate->description.data(), descriptionLength);
+
+	// Step 2: Feature transformer
+	reader.read32();
+	candidate->featureBiases.resize(nnueHalfDimensions);
+	candidate->featureWeights.resize((size_t)nnueInputs * nnueHalfDimensions);
+	reader.read(candidate->featureBiases.data(), candidate->featureBiases.size());
+	reader.read(candidate->featureWeights.data(), candidate->featureWeights.size());
+
+	// Step 3: Hidden and output layers
+	reader.read32();
+	reader.read(candidate->hidden1Biases, nnueHidden);
+	reader.read(candidate->hidden1Weights, nnueHidden * 2 * nnueHalfDimensions);
+	reader.read(candidate->hidden2Biases, nnueHidden);
+	reader.read(candidate->hidden2Weights, nnueHidden * nnueHidden);
+	reader.read(candidate->outputBias, 1);
+	reader.read(candidate->outputWeights, nnueHidden);
+
+	if (!reader.ok || reader.cur != reader.end) return false;
+
+	net = std::move(*candidate);
+	return true;
+}
+
+bool loadNetwork(const std::string& path) {
+	bool loaded = false;
+#if KF_EMBEDDED_NET
+	if (path == defaultEvalFile) loaded = parseNetwork(kfEmbeddedNet, kfEmbeddedNetEnd - kfEmbeddedNet);
+#endif
+	if (!loaded) {
+		MappedFile file;
+		loaded = file.open(path) && parseNetwork(file.data, file.size);
+	}
+	if (loaded) loadedFile = path;
+	return loaded;
+}
+
+void setNNUE(bool enabled) {
+	OutputLine out;
+	useNNUE = false;
+	if (!enabled) return;
+
+	if (loadedFile != evalFile && !loadNetwork(evalFile)) {
+		out << "info string Could not load network " << evalFile << ", using the classical evaluation";
+		out.send();
+		return;
+	}
+	useNNUE = true;
+	out << "info string Using network " << loadedFile;
+	out.send();
+}
+
+// Stockfish 12 rotates the board for black, so that both perspectives see their own pieces at the bottom
+static inline int orient(int perspective, int sqr) {
+	return (perspective == WHITE) ? sqr : sqr ^ 63;
+}
+
+static inline const int16_t* featureWeights(int perspective, int kingSquare, int piece, int sqr) {
+	// Our pawns come first, then enemy pawns, our knights and so on
+	const int pieceIndex = 1 + 128 * pieceType(piece) + 64 * (pieceColor(piece) != perspective);
+	const int index = nnuePieceSquares * orient(perspective, kingSquare) + pieceIndex + orient(perspective, sqr);
+	return net.featureWeights.data() + (size_t)index * nnueHalfDimensions;
+}
+
+static void refreshPerspective(const Board& b, Accumulator& acc, int perspective) {
+	const int kingSquare = b.kingSquares[perspective];
+	const int16_t* added[32];
+	int count = 0;
+
+	uint64_t pieces = ~b.colors[NO_COLOR] & ~b.pieces[KING];
+	while (pieces) {
+		const int sqr = popBit(pieces);
+		added[count++] = featureWeights(perspective, kingSquare, b.squares[sqr], sqr);
+	}
+	accumulate(acc.values[perspective], net.featureBiases.data(), added, count, nullptr, 0);
+}
+
+void refreshAccumulator(const Board& b, Accumulator& acc) {
+	refreshPerspective(b, acc, WHITE);
+	refreshPerspective(b, acc, BLACK);
+}
+
+void updateAccumulator(const Board& b, const DirtyPieces& dirty, const Accumulator& previous, Accumulator& acc) {
+	for (int perspective = WHITE; perspective <= BLACK; ++perspective) {
+		const int kingSquare = b.kingSquares[perspective];
+		const int16_t* added[3];
+		const int16_t* removed[3];
+		int addedCount = 0;
+		int removedCount = 0;
+		bool kingMoved = false;
+
+		for (int i = 0; i < dirty.count; ++i) {
+			const int piece = dirty.piece[i];
+			if (pieceType(piece) == KING) {
+				kingMoved |= (pieceColor(piece) == perspective);
+				continue;
+			}
+			if (dirty.from[i] >= 0) removed[removedCount++] = featureWeights(perspective, kingSquare, piece, dirty.from[i]);
+			if (dirty.to[i] >= 0) added[addedCount++] = featureWeights(perspective, kingSquare, piece, dirty.to[i]);
+		}
+
+		// Every feature depends on our king square, so a king move changes all of them
+		if (kingMoved) refreshPerspective(b, acc, perspective);
+		else accumulate(acc.values[perspective], previous.values[perspective], added, addedCount, removed, removedCount);
+	}
+}
+
+void dirtyPieces(const Board& b, const uint16_t& m, DirtyPieces& dirty) {
+	const int from = moveFrom(m);
+	const int to = moveTo(m);
+	const int piece = b.squares[from];
+
+	auto add = [&dirty](int p, int fromSqr, int toSqr) {
+		dirty.piece[dirty.count] = p;
+		dirty.from[dirty.count] = fromSqr;
+		dirty.to[dirty.count] = toSqr;
+		dirty.count++;
+	};
+
+	dirty.count = 0;
+	switch (moveFlag(m)) {
+	default:  // Promotion
+		add(piece, from, -1);
+		add(makePiece(KNIGHT + moveFlag(m) - PROMOTION_KNIGHT, b.turn), -1, to);
+		if (b.squares[to] != EMPTY) add(b.squares[to], to, -1);
+		break;
+	case NORMAL_MOVE:
+		add(piece, from, to);
+		if (b.squares[to] != EMPTY) add(b.squares[to], to, -1);
+		break;
+	case EP_MOVE:
+		add(piece, from, to);
+		add(makePiece(PAWN, !b.turn), b.epSquare - 8 + (b.turn << 4), -1);
+		break;
+	case CASTLE_MOVE: {
+		const bool kingSide = (to == G1 || to == G8);
+		add(piece, from, to);
+		add(makePiece(ROOK, b.turn), from + (kingSide ? 3 : -4), from + (kingSide ? 1 : -1));
+		break;
+	}
+	}
+}
+
+static inline uint8_t clipped(int32_t value) {
+	return (uint8_t)std::min(std::max(value, 0), nnueClip);
+}
+
+int evaluateNNUE(const Board& b) {
+	Accumulator scratch;
+	const Accumulator* acc = b.accumulator;
+	if (!acc) {
+		refreshAccumulator(b, scratch);
+		acc = &scratch;
+	}
+
+	// Step 1: Feature transformer
+	// The side to move always comes first
+	alignas(64) uint8_t input[2 * nnueHalfDimensions];
+	const int perspectives[2] = { b.turn, !b.turn };
+	for (int p = 0; p < 2; ++p) {
+		for (int i = 0; i < nnueHalfDimensions; ++i) {
+			input[p * nnueHalfDimensions + i] = clipped(acc->values[perspectives[p]][i]);
+		}
+	}
+
+	// Step 2: Hidden layers
+	alignas(64) int32_t sums[nnueHidden];
+	alignas(64) uint8_t hidden1[nnueHidden];
+	alignas(64) uint8_t hidden2[nnueHidden];
+
+	affine(input, 2 * nnueHalfDimensions, net.hidden1Weights, net.hidden1Biases, sums, nnueHidden);
+	for (int i = 0; i < nnueHidden; ++i) hidden1[i] = clipped(sums[i] >> nnueWeightShift);
+
+	affine(hidden1, nnueHidden, net.hidden2Weights, net.hidden2Biases, sums, nnueHidden);
+	for (int i = 0; i < nnueHidden; ++i) hidden2[i] = clipped(sums[i] >> nnueWeightShift);
+
+	// Step 3: Output, converted to centipawns from the side to move's point of view
+	// A network with large weights can overflow the conversion or produce mate scores, so we widen and clamp it
+	int32_t output;
+	affine(hidden2, nnueHidden, net.outputWeights, net.outputBias, &output, 1);
+	const int64_t score = (int64_t)output * nnuePawnValue / nnueOutputScale;
+	return (int)std::min<int64_t>(std::max<int64_t>(score, MATED_IN_MAX + 1), MATE_IN_MAX - 1);
+}
@@ -0,0 +1,64 @@
+#ifndef NNUE_H
+#define NNUE_H
+
+#include "types.h"
+
+// HalfKP networks in the format of Stockfish 12: 41024 features -> 2 x 256 -> 32 -> 32 -> 1
+// A feature is a (king square, piece, square) triple seen from one side, kings themselves are not features
+static constexpr int nnueKingBuckets = 64;
+static constexpr int nnuePieceSquares = 641;  // 10 piece kinds on 64 squares, plus one unused index
+static constexpr int nnueInputs = nnueKingBuckets * nnuePieceSquares;
+static constexpr int nnueHalfDimensions = 256;
+static constexpr int nnueHidden = 32;
+
+static constexpr uint32_t nnueVersion = 0x7af32f16;
+static constexpr int nnueWeightShift = 6;  // Hidden layer outputs are scaled down by 64 before clipping
+static constexpr int nnueClip = 127;
+
+// The output is in units of 1/16 of an internal Stockfish value, where an endgame pawn is worth 208
+static constexpr int nnueOutputScale = 16 * 208;
+static constexpr int nnuePawnValue = 100;
+
+static constexpr const char* defaultEvalFile = "nn-82215d0fd0df.nnue";
+
+// Networks can be linked into the binary with -DKF_EVAL_FILE=\"path/to/net.nnue\" on ELF platforms
+// The embedded network is used whenever EvalFile is left at its default
+#if defined(KF_EVAL_FILE) && defined(__GNUC__) && defined(__ELF__)
+#define KF_EMBEDDED_NET 1
+#else
+#define KF_EMBEDDED_NET 0
+#endif
+
+// Sums of the first layer weights of all active features, for both perspectives
+// Owned by a MoveState slot, the board only points to it, so copying a board stays cheap
+struct alignas(64) Accumulator {
+	int16_t values[2][nnueHalfDimensions];
+};
+
+// Up to three pieces change with a move: the mover, a captured piece and the castling rook
+// A promotion removes the pawn and adds the new piece, a square of -1 means the piece is not on the board
+struct DirtyPieces {
+	int count;
+	int piece[3];
+	int from[3];
+	int to[3];
+};
+
+extern bool useNNUE;
+extern std::string evalFile;
+
+void initNNUE();
+
+bool loadNetwork(const std::string& path);
+
+// Turns the network on or off, loading EvalFile first if it is not loaded yet
+// If it cannot be loaded we stay with the classical evaluation
+void setNNUE(bool enabled);
+
+void refreshAccumulator(const Board& b, Accumulator& acc);
+void updateAccumulator(const Board& b, const DirtyPieces& dirty, const Accumulator& previous, Accumulator& acc);
+void dirtyPieces(const Board& b, const uint16_t& m, DirtyPieces& dirty);
+
+int evaluateNNUE(const Board& b);
+
+#endif
@@ -0,0 +1,28 @@
+#include "move.h"
+#include "output.h"
+#include "types.h"
+
+std::mutex outputMutex;
+
+OutputLine& OutputLine::move(uint16_t m) {
+	if (!m) return *this << std::string_view("0000");
+	if (length + 5 >= outputBufferSize - 1) return *this;
+
+	static constexpr char promotionChars[] = { 'n', 'b', 'r', 'q' };
+	buffer[length++] = char(moveFrom(m) % 8 + 'a');
+	buffer[length++] = char(moveFrom(m) / 8 + '1');
+	buffer[length++] = char(moveTo(m) % 8 + 'a');
+	buffer[length++] = char(moveTo(m) / 8 + '1');
+	if (moveFlag(m) >= PROMOTION_KNIGHT) buffer[length++] = promotionChars[moveFlag(m) - PROMOTION_KNIGHT];
+	return *this;
+}
+
+void OutputLine::send() {
+	buffer[length++] = '\n';
+	{
+		std::lock_guard<std::mutex> lock(outputMutex);
+		std::cout.write(buffer, length);
+		std::cout.flush();
+	}
+	length = 0;
+}
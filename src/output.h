@@ -0,0 +1,55 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include "types.h"
+
+static constexpr int outputBufferSize = 4096;
+
+// Iterations of a short search finish almost at once, so info lines are sent at most this often (in ms)
+// The last completed iteration is always reported before the best move
+static constexpr int infoMinInterval = 20;
+
+// Serializes output from the search thread and the input thread
+extern std::mutex outputMutex;
+
+// Formats one line of output into a fixed buffer and writes it with a single flush
+// Nothing is allocated, numbers and moves are converted in place
+struct OutputLine {
+	char buffer[outputBufferSize];
+	size_t length = 0;
+
+	OutputLine& operator<<(std::string_view s) {
+		size_t n = std::min(s.size(), outputBufferSize - 1 - length);
+		memcpy(buffer + length, s.data(), n);
+		length += n;
+		return *this;
+	}
+
+	OutputLine& operator<<(char c) {
+		if (length < outputBufferSize - 1) buffer[length++] = c;
+		return *this;
+	}
+
+	OutputLine& operator<<(int64_t n) {
+		auto [end, ec] = std::to_chars(buffer + length, buffer + outputBufferSize - 1, n);
+		if (ec == std::errc()) length = end - buffer;
+		return *this;
+	}
+
+	OutputLine& operator<<(int n) { return *this << (int64_t)n; }
+	OutputLine& operator<<(uint64_t n) { return *this << (int64_t)n; }
+
+	// Percentages and rates in the debug output, always with two decimals
+	OutputLine& operator<<(float f) {
+		auto [end, ec] = std::to_chars(buffer + length, buffer + outputBufferSize - 1, f, std::chars_format::fixed, 2);
+		if (ec == std::errc()) length = end - buffer;
+		return *this;
+	}
+
+	OutputLine& move(uint16_t m);
+
+	// Terminates the line, writes it and flushes, then starts a new line
+	void send();
+};
+
+#endif
@@ -0,0 +1,97 @@
+#include "bitboard.h"
+#include "board.h"
+#include "evaluate.h"
+#include "masks.h"
+#include "pawns.h"
+#include "types.h"
+
+// A member of a type shared by every copy of the hot code, so only the default copy defines it
+#if !KF_ISA_COPY
+PawnTable::PawnTable() {
+	resizePawnHash(*this, defaultPawnHashSize);
+}
+#endif
+
+inline namespace KF_ISA {
+
+void resizePawnHash(PawnTable& table, int megabytes) {
+	// Round down to a power of two so that the index is a mask
+	size_t entries = 1;
+	while (entries * 2 * sizeof(PawnEntry) <= ((size_t)megabytes << 20)) entries *= 2;
+	table.entries.assign(entries, PawnEntry());
+	table.mask = entries - 1;
+}
+
+void clearPawnHash(PawnTable& table) {
+	for (auto& entry : table.entries) entry = PawnEntry();
+}
+
+static void computePawns(const Board& b, PawnEntry& pe, int color) {
+	// Every term is computed for all pawns of a color at once, so the cost does not depend on the number of pawns
+	const uint64_t pawns = b.pieces[PAWN] & b.colors[color];
+	const uint64_t enemyPawns = b.pieces[PAWN] & b.colors[!color];
+	const uint64_t files = fileFill(pawns);
+	int mg = 0;
+
+	// Step 1: Supported pawns
+	// We give a bonus to pawns that defend each other
+	mg += countBits(pawns & pawnAttackSet(pawns, !color)) * supportedPawnBonus;
+
+	// Step 2: Phalanx pawns
+	// We give a bonus to pawns that are beside each other
+	mg += (countBits((pawns & (pawns >> 1) & ~fileHMask) | (pawns & (pawns << 1) & ~fileAMask))) * phalanxPawnBonus;
+
+	// Step 3: Doubled pawns
+	// We give a penalty for every file with more than one pawn, i.e. a file with a pawn that has another pawn in front of it
+	const uint64_t doubled = pawns & frontFill(pawnPush(pawns, !color), !color);
+	mg -= countBits(fileFill(doubled) & rank1Mask) * doubledPawnPenalty;
+
+	int eg = mg;  // The above evaluation terms are not phase-dependent
+
+	// Step 4: Isolated pawns
+	// We give a penalty if there are pawns that do not have friendly pawns in neighboring files that could support them
+	const uint64_t isolated = pawns & ~(((files << 1) & ~fileAMask) | ((files >> 1) & ~fileHMask));
+	mg -= countBits(isolated) * isolatedPawnPenalty;
+	eg -= countBits(isolated) * isolatedPawnPenalty;
+
+	// Step 5: Passed pawns
+	// A pawn is passed if no enemy pawn is in front of it or can capture it on its way
+	// Their bonus depends on whether they are blocked, so only the pawns themselves are stored
+	const uint64_t enemySpans = frontFill(pawnPush(enemyPawns, !color) | pawnAttackSet(enemyPawns, !color), !color);
+	pe.passed[color] = pawns & ~enemySpans;
+
+	// Step 6: Pawn attacks, the squares pawns could attack as they advance, and files without our pawns
+	pe.attacks[color] = pawnAttackSet(pawns, color);
+	pe.attackSpans[color] = frontFill(pe.attacks[color], color);
+	pe.semiOpenFiles[color] = (uint8_t)~(files & rank1Mask);
+
+	pe.score[color] = makeScore(mg, eg);
+	pe.shelterSquare[color] = -1;
+}
+
+void computePawns(const Board& b, PawnEntry& pe) {
+	pe.key = b.pawnKey;
+	computePawns(b, pe, WHITE);
+	computePawns(b, pe, BLACK);
+}
+
+PawnEntry& probePawns(PawnTable& table, const Board& b) {
+	PawnEntry& pe = table.entries[b.pawnKey & table.mask];
+	if (pe.key != b.pawnKey) computePawns(b, pe);
+	return pe;
+}
+
+int kingShelter(const Board& b, PawnEntry& pe, int color, int kingSquare) {
+	if (pe.shelterSquare[color] == kingSquare) return pe.shelter[color];
+
+	// Pawns on the rank in front of the king, and beside it
+	const int shelterRank = kingSquare / 8 + ((color == WHITE) ? 1 : -1);
+	const uint64_t front = (shelterRank >= 0 && shelterRank < 8) ? kingRing[kingSquare] & rankMasks[shelterRank] & ~(rank1Mask | rank8Mask) : 0;
+	const uint64_t shelter = front | (((1ull << kingSquare) >> 1) & ~fileHMask) | (((1ull << kingSquare) << 1) & ~fileAMask);
+
+	pe.shelterSquare[color] = kingSquare;
+	pe.shelter[color] = kingShelterBonus[countBits(shelter & b.pieces[PAWN] & b.colors[color])];
+	return pe.shelter[color];
+}
+
+}
@@ -0,0 +1,48 @@
+#ifndef PAWNS_H
+#define PAWNS_H
+
+#include "cpu.h"
+#include "types.h"
+
+static constexpr int defaultPawnHashSize = 4;  // MB
+static constexpr int maxPawnHashSize = 256;
+
+// Everything about a pawn structure that does not depend on the other pieces
+// Scores are from the point of view of the pawns' own color
+struct PawnEntry {
+	uint64_t key = ~0ull;  // A key of 0 is a real position without pawns
+	PackedScore score[2];
+	uint64_t passed[2];
+	uint64_t attacks[2];  // Squares attacked by pawns
+	uint64_t attackSpans[2];  // Squares pawns could attack as they advance
+	uint8_t semiOpenFiles[2];  // Bit f is set if the color has no pawn on file f
+
+	// King shelter only depends on our pawns and the king square, so it is filled in on first use
+	int8_t shelterSquare[2];
+	int shelter[2];
+
+	int openFile(int file) const {
+		return ((semiOpenFiles[WHITE] >> file) & 1) + ((semiOpenFiles[BLACK] >> file) & 1);
+	}
+};
+
+// Entries are written without locks, so every search owns its table instead of sharing one
+struct PawnTable {
+	std::vector<PawnEntry> entries;
+	uint64_t mask = 0;
+
+	PawnTable();
+};
+
+inline namespace KF_ISA {
+
+void resizePawnHash(PawnTable& table, int megabytes);
+void clearPawnHash(PawnTable& table);
+
+void computePawns(const Board& b, PawnEntry& pe);
+PawnEntry& probePawns(PawnTable& table, const Board& b);
+int kingShelter(const Board& b, PawnEntry& pe, int color, int kingSquare);
+
+}
+
+#endif
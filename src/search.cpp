@@ -9,31 +9,34 @@
 #include "tt.h"
 #include "types.h"
 
-void initSearch(SearchInfo& si) {
-	// Reset killers
-	for (int i = 0; i <= MAX_PLY; ++i) {
-		killers[0][i] = 0;
-		killers[1][i] = 0;
-	}
+inline namespace KF_ISA {
 
-	// Reset history scores
-	for (int i = 0; i < 2; ++i) {
-		for (int j = 0; j < 6; ++j) {
-			for (int k = 0; k < SQUARE_NUM; k++) {
-				historyMoves[i][j][k] = 0;
-			}
-		}
-	}
+void initSearch(SearchInfo& si) {
+	// Reset killers and history scores
+	si.thread.clear();
 
 	si.reset();
+	si.totalNodes = 0;
+
+	// Room for one key per ply of the search, so the history is not reallocated while searching
+	si.history.keys.reserve(si.history.keys.size() + 2 * MAX_PLY);
 }
 
 void timeCheck(SearchInfo& si, const bool ignoreDepth, const bool ignoreNodeCount) {
-	// We check for time every 1024 nodes to reduce calls to clock()
+	// We only read the clock every few nodes, the interval adapts to the measured speed of the search
 	bool depthFlag = (ignoreDepth || (!ignoreDepth && si.depth > 1));
-	bool nodeFlag = (ignoreNodeCount|| (!ignoreNodeCount && (((si.nodes + si.qnodes) & 1023) == 0)));
+
+	// The node limit is exact, so it is checked at every node
+	if (depthFlag && si.limits.nodes && si.searchedNodes() >= si.limits.nodes) {
+		si.abort = true;
+		return;
+	}
+
+	bool nodeFlag = (ignoreNodeCount || si.tm.tick());
 	if (depthFlag && nodeFlag) {
-		si.abort = ((double)(clock() - si.start) / (CLOCKS_PER_SEC / 1000) >= si.limit);
+		// While pondering we search on the opponent's time, so only "stop" can end the search
+		bool timeUp = !si.pondering.load(std::memory_order_relaxed) && si.tm.hardExpired();
+		si.abort = timeUp || si.stop.load(std::memory_order_relaxed);
 	}
 }
 
@@ -42,7 +45,7 @@ void updateHistory(int& entry, int delta) {
 	entry += historyMultiplier * delta - entry * abs(delta) / historyDivisor;
 }
 
-int scoreMove(const Board& b, const uint16_t& m, int ply, int phase, const uint16_t& hashMove) {
+int scoreMove(const Board& b, const uint16_t& m, int ply, const uint16_t& hashMove, const SearchThread& thread) {
 	
 	// We order our moves before we search them in order to maximize the chance of causing a beta-cutoff in the first few moves searched
 
@@ -66,26 +69,26 @@ int scoreMove(const Board& b, const uint16_t& m, int ply, int phase, const uint1
 	}
 
 	// Killer moves
-	if (m == killers[0][ply]) return killerBonus[0];
-	if (m == killers[1][ply]) return killerBonus[1];
+	const uint16_t (&killers)[2] = thread.stack[ply].killers;
+	if (m == killers[0]) return killerBonus[0];
+	if (m == killers[1]) return killerBonus[1];
 	if (ply - 2 >= 0) {
-		if (m == killers[0][ply - 2]) return killerBonus[2];
-		if (m == killers[1][ply - 2]) return killerBonus[3];
+		if (m == thread.stack[ply - 2].killers[0]) return killerBonus[2];
+		if (m == thread.stack[ply - 2].killers[1]) return killerBonus[3];
 	}
 
 	// History heuristic
-	int historyScore = historyMoves[b.turn][pieceType(b.squares[from])][to];
+	int historyScore = thread.history[b.turn][pieceType(b.squares[from])][to];
 	return (-historyMax - 5) + historyScore;
 }
 
-std::vector<ScoredMove> scoreMoves(const Board& b, const std::vector<uint16_t>& moves, int ply, const uint16_t& hashMove) {
-	int phase = getPhase(b);
+std::vector<ScoredMove> scoreMoves(const Board& b, const std::vector<uint16_t>& moves, int ply, const uint16_t& hashMove, const SearchThread& thread) {
 	int size = moves.size();
 	std::vector<ScoredMove> scoredMoves(size);
 
 	for (int i = 0; i < size; ++i) {
 		scoredMoves[i].m = moves[i];
-		scoredMoves[i].score = scoreMove(b, moves[i], ply, phase, hashMove);
+		scoredMoves[i].score = scoreMove(b, moves[i], ply, hashMove, thread);
 	}
 	return scoredMoves;
 }
@@ -115,11 +118,30 @@ std::vector<ScoredMove> scoreNoisyMoves(const Board& b, const std::vector<uint16
 	return scoredMoves;
 }
 
+int staticEval(const Board& b, int alpha, int beta, bool& lazy, SearchInfo& si) {
+	si.evalCacheProbes++;
+	int eval = probeEvalCache(b.key);
+	if (eval != NO_VALUE) {
+		si.evalCacheHits++;
+		lazy = false;
+		return eval;
+	}
+
+	// A lazy evaluation only holds for this window, so it is not cached
+	eval = evaluate(b, b.turn, si.thread.evalTables, alpha, beta, lazy);
+	if (lazy) si.lazyEvals++;
+	else storeEvalCache(b.key, eval);
+	return eval;
+}
+
 int search(Board& b, int depth, int ply, int alpha, int beta, SearchInfo& si, uint16_t (&ppv)[MAX_PLY], bool allowNull = true) {
 	bool isRoot = (!ply);
 	bool isPV = (alpha != beta - 1);
 	bool nearMate = (alpha <= MATED_IN_MAX || alpha >= MATE_IN_MAX || beta <= MATED_IN_MAX || beta >= MATE_IN_MAX);
 	bool isInCheck = inCheck(b, b.turn);
+
+	// The per-ply tables end at MAX_PLY, check extensions and qsearch can otherwise run past them
+	if (ply >= MAX_PLY) return evaluate(b, b.turn, si.thread.evalTables);
 	if (ply > si.seldepth) si.seldepth = ply;
 
 	// Step 0: Leaf node
@@ -149,8 +171,13 @@ int search(Board& b, int depth, int ply, int alpha, int beta, SearchInfo& si, ui
 	int ttEval = NO_VALUE;
 
 	if (!isRoot) {
-		// Step 2: Check for 3-fold repetition
-		if (drawnByRepetition(b)) return 0;
+		// Step 2: Draw detection
+		// If we can repeat a position of the search with our next move, we are guaranteed at least a draw
+		if (isDraw(b, si.history)) return 0;
+		if (alpha < 0 && hasUpcomingRepetition(b, si.history, ply)) {
+			alpha = 0;
+			if (alpha >= beta) return alpha;
+		}
 
 		// Step 3: Mate distance pruning
 		// We have already found mate, so we can prune irrevelant branches that have no chance of giving a shorter mate
@@ -169,7 +196,10 @@ int search(Board& b, int depth, int ply, int alpha, int beta, SearchInfo& si, ui
 
 	// Step 4b: Probe transposition table for evaluation score
 	// If we have already visited this position, we can reuse the evaluation score without having to calculate it again
-	int eval = (ttEval == NO_VALUE) ? evaluate(b, b.turn) : ttEval;
+	// Otherwise it comes from the eval cache, or stops early if it is far outside the window widened by the futility margins
+	bool lazyEval = false;
+	int eval = (ttEval == NO_VALUE) ? staticEval(b, alpha - futilityMargin * depth, beta + futilityMargin * depth, lazyEval, si) : ttEval;
+	SearchStack& ss = si.thread.stack[ply];
 
 	// Step 5: Reverse futility pruning / Static null move pruning
 	// Our static evaluation score is so good that we can still cause a beta cutoff even after deducting a safety margin
@@ -184,12 +214,15 @@ int search(Board& b, int depth, int ply, int alpha, int beta, SearchInfo& si, ui
 	// Step 6: Null move pruning
 	// If we don't make a move, and a reduced search still causes a beta cutoff, we do a cutoff immediately
 	// We do not use null move pruning in pawn endgames as it would fail in zugzwang
-	if (!isPV && allowNull && depth >= nullMoveMinDepth && !isInCheck && getPhase(b) != 0) {
-		auto u = makeNullMove(b);
+	if (!isPV && allowNull && depth >= nullMoveMinDepth && !isInCheck && b.phase != 0) {
+		MoveState state;
+		Board& child = state.makeNull(b);
+		si.history.push(child.key);
 		int nullMoveR = nullMoveBaseR + depth / 6;
 		nullMoveR = std::min(nullMoveR, 4);
-		score = -search(b, depth - 1 - nullMoveR, ply + 1, -beta, -beta + 1, si, pv, false);
-		undoNullMove(b, u);
+		score = -search(child, depth - 1 - nullMoveR, ply + 1, -beta, -beta + 1, si, pv, false);
+		si.history.pop();
+		state.undoNull(b);
 		if (score >= beta) return score;
 	}
 
@@ -206,23 +239,26 @@ int search(Board& b, int depth, int ply, int alpha, int beta, SearchInfo& si, ui
 
 	while (stage != NO_MOVES_LEFT) {
 		// Step 7: We pick our next move from an ordered list of moves
-		uint16_t m = pickNextMove(b, hashMove, stage, moves, ply, movesTried);
+		uint16_t m = pickNextMove(b, hashMove, stage, moves, ply, movesTried, si.thread);
 		if (!m) {
 			stage = NO_MOVES_LEFT;
 			break;
 		}
 
+		// Root moves can be restricted by "go searchmoves"
+		if (isRoot && !si.rootMoveAllowed(m)) continue;
+
 		// Move info
 		const int from = moveFrom(m);
 		const int to = moveTo(m);
 		const int flag = moveFlag(m);
-		const int historyScore = historyMoves[b.turn][pieceType(b.squares[from])][to];
+		const int historyScore = si.thread.history[b.turn][pieceType(b.squares[from])][to];
 
 		// Move flags
 		bool isCapture = (b.squares[to] != EMPTY || flag == EP_MOVE);
 		bool isPromotion = (flag >= PROMOTION_KNIGHT);
 		bool isNoisy = (isCapture || isPromotion);
-		bool isKiller = (m == killers[0][ply] || m == killers[1][ply]);
+		bool isKiller = (m == ss.killers[0] || m == ss.killers[1]);
 		bool isHash = (m == hashMove);
 
 		bool isPassedPawn = (b.turn == WHITE) ?
@@ -249,15 +285,17 @@ int search(Board& b, int depth, int ply, int alpha, int beta, SearchInfo& si, ui
 		}
 
 		// Step 10: Make move and check for legality
-		auto u = makeMove(b, m);
-		if (inCheck(b, !b.turn)) {
-			undoMove(b, m, u);
+		MoveState state(&si.thread.accumulators[ply + 1]);
+		Board& child = state.make(b, m);
+		if (inCheck(child, !child.turn)) {
+			state.undo(b, m);
 			continue;
 		}
 
+		si.history.push(child.key);
 		movesSearched++;
 
-		bool isCheck = inCheck(b, b.turn);
+		bool isCheck = inCheck(child, child.turn);
 		if (isHash) si.hashCount++;
 
 		score = alpha + 1;
@@ -277,24 +315,25 @@ int search(Board& b, int depth, int ply, int alpha, int beta, SearchInfo& si, ui
 			// lateMoveR -= std::max(std::min(historyScore * 2 / historyMax, 2), -2);
 
 			lateMoveR = std::max(0, std::min(lateMoveR, depth - 1));  // Do not drop directly into qsearch
-			score = -search(b, depth - lateMoveR - 1, ply + 1, -alpha - 1, -alpha, si, pv);
+			score = -search(child, depth - lateMoveR - 1, ply + 1, -alpha - 1, -alpha, si, pv);
 		}
 
 		// Step 12: Do a complete search if we are searching for the first time/the reduced search from LMR raised alpha
 		// We also extend our search by one ply if we are in check
-		if (score > alpha) score = -search(b, depth - 1 + (isInCheck), ply + 1, -beta, -alpha, si, pv);
+		if (score > alpha) score = -search(child, depth - 1 + (isInCheck), ply + 1, -beta, -alpha, si, pv);
 
-		undoMove(b, m, u);
+		si.history.pop();
+		state.undo(b, m);
 
 		if (score >= beta) {
-			storeTT(b.key, depth, beta, TT_BETA, eval, ply, m);
+			if (!isRoot || !si.pvIndex) storeTT(b.key, depth, beta, TT_BETA, lazyEval ? NO_VALUE : eval, ply, m);
 
 			// Step 13: Killer heuristic
 			// Quiet moves that cause a cutoff might be good in the same ply
 			// We maintain two buckets each ply
-			if (!isNoisy && m != killers[0][ply]) {
-				killers[1][ply] = killers[0][ply];
-				killers[0][ply] = m;
+			if (!isNoisy && m != ss.killers[0]) {
+				ss.killers[1] = ss.killers[0];
+				ss.killers[0] = m;
 			}
 
 			// Step 14a: History heuristic
@@ -302,7 +341,7 @@ int search(Board& b, int depth, int ply, int alpha, int beta, SearchInfo& si, ui
 			// We increment history scores by depth squared in order to increase the importance of cutoffs near the root
 			// We limit history scores to a certain maximum depth as they tend to become noise at higher depths
 			if (!isNoisy && depth <= historyMaxDepth) {
-				updateHistory(historyMoves[b.turn][pieceType(b.squares[from])][to], depth * depth);
+				updateHistory(si.thread.history[b.turn][pieceType(b.squares[from])][to], depth * depth);
 			}
 
 			// ### DEBUG ###
@@ -334,7 +373,7 @@ int search(Board& b, int depth, int ply, int alpha, int beta, SearchInfo& si, ui
 			// Step 14b: History heuristic
 			// We give a penalty to quiet moves that did not raise alpha
 			if (!isNoisy && depth <= historyMaxDepth) {
-				updateHistory(historyMoves[b.turn][pieceType(b.squares[from])][to], -depth * depth / 2);
+				updateHistory(si.thread.history[b.turn][pieceType(b.squares[from])][to], -depth * depth / 2);
 			}
 		}
 	}
@@ -347,7 +386,8 @@ int search(Board& b, int depth, int ply, int alpha, int beta, SearchInfo& si, ui
 
 	// Step 16: Store transposition table
 	// We store the results of our search in the transposition table
-	storeTT(b.key, depth, alpha, TTFlag, eval, ply, bestMove);
+	// Secondary MultiPV lines are not stored at the root as their best move ignores the excluded moves
+	if (!isRoot || !si.pvIndex) storeTT(b.key, depth, alpha, TTFlag, lazyEval ? NO_VALUE : eval, ply, bestMove);
 
 	if (isRoot) {
 		si.score = alpha;
@@ -358,25 +398,25 @@ int search(Board& b, int depth, int ply, int alpha, int beta, SearchInfo& si, ui
 }
 
 int qsearch(Board& b, int ply, int alpha, int beta, SearchInfo& si, uint16_t (&ppv)[MAX_PLY]) {
+	if (ply >= MAX_PLY) return evaluate(b, b.turn, si.thread.evalTables);
 	if (ply > si.seldepth) si.seldepth = ply;
 
 	si.qnodes++;
 
-	timeCheck(si, true, false);
+	timeCheck(si, false, false);
 	if (si.abort) return alpha;
 
-	// Step 1: Check for 3-fold repetition
-	if (drawnByRepetition(b)) return 0;
-
-	// Step 2: Probe quiescence search evaluation hash table
-	// If we have already visited this position, we can reuse the evaluation score without having to calculate it again
-	int qHashEval = probeQHash(b.key);
-	bool hit = (qHashEval != NO_VALUE);
-
-	int eval = (hit) ? qHashEval : evaluate(b, b.turn);
+	// Step 1: Draw detection
+	if (isDraw(b, si.history)) return 0;
+	if (alpha < 0 && hasUpcomingRepetition(b, si.history, ply)) {
+		alpha = 0;
+		if (alpha >= beta) return alpha;
+	}
 
-	if (!hit) storeQHash(b.key, eval);
-	if (hit) si.qHashHit++;
+	// Step 2: Static evaluation
+	// If we have already evaluated this position, we can reuse the evaluation score without having to calculate it again
+	bool lazyEval = false;
+	int eval = staticEval(b, alpha, beta, lazyEval, si);
 
 	// Step 3: Standing pat
 	// If the static evaluation alone is good enough to cause a beta cutoff, we cutoff immediately
@@ -409,16 +449,19 @@ int qsearch(Board& b, int ply, int alpha, int beta, SearchInfo& si, uint16_t (&p
 		// We skip this move if we would lose the exchange that would ensue
 		if (!staticExchangeEvaluation(b, m)) continue;
 
-		auto u = makeMove(b, m);
-		if (inCheck(b, !b.turn)) {
-			undoMove(b, m, u);
+		MoveState state(&si.thread.accumulators[ply + 1]);
+		Board& child = state.make(b, m);
+		if (inCheck(child, !child.turn)) {
+			state.undo(b, m);
 			continue;
 		}
 
+		si.history.push(child.key);
 		movesSearched++;
 
-		int score = -qsearch(b, ply + 1, -beta, -alpha, si, pv);
-		undoMove(b, m, u);
+		int score = -qsearch(child, ply + 1, -beta, -alpha, si, pv);
+		si.history.pop();
+		state.undo(b, m);
 
 		if (score >= beta) {
 			// Update qsearch move ordering info
@@ -516,45 +559,142 @@ int greatestTacticalGain(const Board& b) {
 	return val;
 }
 
-void iterativeDeepening(Board& b, SearchInfo& si, int timeLimit) {
+uint16_t getPonderMove(Board& b, const SearchInfo& si) {
+	if (!si.bestMove) return 0;
+
+	// We expect the second PV move, falling back to the hash move after our best move if the PV was cut short
+	uint16_t ponderMove = 0;
+	auto u = makeMove(b, si.bestMove);
+	uint16_t candidate = (si.pv[0] == si.bestMove && si.pv[1]) ? si.pv[1] : probeHashMove(b.key);
+	if (moveIsPsuedoLegal(b, candidate)) {
+		auto v = makeMove(b, candidate);
+		if (!inCheck(b, !b.turn)) ponderMove = candidate;
+		undoMove(b, candidate, v);
+	}
+	undoMove(b, si.bestMove, u);
+	return ponderMove;
+}
+
+int countRootMoves(Board& b, const SearchInfo& si) {
+	int count = 0;
+	auto moves = genAllMoves(b);
+	for (const auto& m : moves) {
+		if (!si.rootMoveAllowed(m)) continue;
+		auto u = makeMove(b, m);
+		if (!inCheck(b, !b.turn)) count++;
+		undoMove(b, m, u);
+	}
+	return count;
+}
+
+void iterativeDeepening(Board& b, SearchInfo& si) {
 	SearchInfo searchCache;
-	uint16_t bestMove = 0;
+	int printedDepth = 0;
+	int64_t nextInfoTime = 0;
 	initSearch(si);
-	si.initTime(timeLimit);
-
-	int alpha = -MATE_SCORE;
-	int beta = MATE_SCORE;
-	bool research = false;
+	si.pvIndex = 0;
+	si.pvCount = std::max(std::min(si.multiPV, countRootMoves(b, si)), 1);
+	for (int k = 0; k < si.pvCount; ++k) si.lines[k] = RootLine();
+	searchCache = si;
 
-	for (int i = 1; i <= MAX_PLY; ++i) {
-		if (!research) searchCache = si;
+	for (int i = 1; i <= si.limits.depth; ++i) {
 		si.reset();
 		si.depth = i;
 
-		int score = search(b, i, 0, alpha, beta, si, si.pv);
-		timeCheck(si, true, true);
-		if (si.abort) break;
-		
-		if ((score <= alpha) || (score >= beta)) {
-			alpha = -MATE_SCORE;
-			beta = MATE_SCORE;
-			i--;
-			research = true;
-			continue;
+		// Every MultiPV line is searched with its own aspiration window, sharing the TT and move ordering with the others
+		for (si.pvIndex = 0; si.pvIndex < si.pvCount; ++si.pvIndex) {
+			RootLine& line = si.lines[si.pvIndex];
+			int alpha = -MATE_SCORE;
+			int beta = MATE_SCORE;
+			if (i > aspirationMinDepth) {
+				alpha = line.score - aspirationWindow;
+				beta = line.score + aspirationWindow;
+			}
+
+			while (1) {
+				for (auto& m : si.pv) m = 0;
+				int score = search(b, i, 0, alpha, beta, si, si.pv);
+				timeCheck(si, true, true);
+				if (si.abort) break;
+
+				if ((score <= alpha) || (score >= beta)) {
+					alpha = -MATE_SCORE;
+					beta = MATE_SCORE;
+					continue;
+				}
+				break;
+			}
+			if (si.abort) break;
+
+			line.score = si.score;
+			for (int k = 0; k < MAX_PLY; ++k) line.pv[k] = si.pv[k];
 		}
+		si.pvIndex = 0;
+		if (si.abort) break;
 
-		si.print();
+		// Lines searched later can occasionally score higher, so we keep them sorted
+		std::stable_sort(si.lines, si.lines + si.pvCount, [](const RootLine& a, const RootLine& b) { return a.score > b.score; });
+		si.score = si.lines[0].score;
+		si.bestMove = si.lines[0].pv[0];
+		for (int k = 0; k < MAX_PLY; ++k) si.pv[k] = si.lines[0].pv[k];
+
+		searchCache = si;
+		const int64_t elapsed = si.tm.elapsed();
+		if (elapsed >= nextInfoTime) {
+			si.print();
+			printedDepth = i;
+			nextInfoTime = elapsed + infoMinInterval;
+		}
 		if (si.debug) si.printSearchDebug();
 
-		research = false;
+		// We do not start another iteration late in the soft limit, which is scaled by the stability of the search
+		si.tm.updateIteration(si.bestMove, si.score);
+		if (!si.tm.canStartIteration() && !si.pondering) break;
 
-		if (i >= aspirationMinDepth) {
-			alpha = si.score - aspirationWindow;
-			beta = si.score + aspirationWindow;
-		}
+		// "go mate" stops as soon as a mate in the requested number of moves is found
+		if (si.limits.mate && si.score >= MATE_IN_MAX && (MATE_SCORE - si.score + 1) / 2 <= si.limits.mate) break;
+	}
+
+	// We are not allowed to send a best move while pondering or in infinite mode, even if the search has finished early
+	while ((si.pondering || si.limits.infinite) && !si.stop) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
 	}
 
 	si = searchCache;
-	std::cout << "bestmove " << toNotation(si.bestMove) << "\n";
+	if (si.depth > printedDepth) si.print();
+
+	uint16_t ponderMove = getPonderMove(b, si);
+	OutputLine out;
+	out << "bestmove ";
+	out.move(si.bestMove);
+	if (ponderMove) {
+		out << " ponder ";
+		out.move(ponderMove);
+	}
+	out.send();
 	ageTT();
-}
\ No newline at end of file
+}
+
+const SearchEntryPoints isaEntryPoints = { iterativeDeepening, perft };
+
+}
+
+#if !KF_ISA_COPY
+#if KF_X86_DISPATCH
+namespace isaPopcnt {
+	extern const SearchEntryPoints isaEntryPoints;
+}
+namespace isaBmi2 {
+	extern const SearchEntryPoints isaEntryPoints;
+}
+#endif
+
+const SearchEntryPoints* entryPoints = &isaEntryPoints;
+
+void initEntryPoints() {
+#if KF_X86_DISPATCH
+	if (cpu.isa == ISA_BMI2) entryPoints = &isaBmi2::isaEntryPoints;
+	else if (cpu.isa == ISA_POPCNT) entryPoints = &isaPopcnt::isaEntryPoints;
+#endif
+}
+#endif
\ No newline at end of file
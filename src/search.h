@@ -2,50 +2,118 @@
 #define SEARCH_H
 
 #include "board.h"
+#include "cpu.h"
 #include "evaluate.h"
 #include "move.h"
+#include "output.h"
+#include "timeman.h"
 #include "types.h"
 
 static constexpr int FAIL_HIGH_MOVES = 6;
 static constexpr int NEAR_LEAF_BOUNDARY = 8;
 
+static constexpr int maxMultiPV = 64;
+
+struct SearchLimits {
+	int depth = MAX_PLY;
+	uint64_t nodes = 0;  // 0 means no node limit
+	int mate = 0;  // Stop once a mate in this many moves is found, 0 means no mate search
+	bool infinite = false;  // Do not send a best move before "stop"
+	std::vector<uint16_t> searchMoves;  // Restricts the root moves if not empty
+
+	void clear() {
+		depth = MAX_PLY;
+		nodes = 0;
+		mate = 0;
+		infinite = false;
+		searchMoves.clear();
+	}
+};
+
+static constexpr int historyMultiplier = 32;
+static constexpr int historyDivisor = 512;
+static constexpr int historyMax = historyMultiplier * historyDivisor;
+static constexpr int historyMaxDepth = 8;
+
+// Move ordering state of one ply of the current line
+struct SearchStack {
+	uint16_t killers[2];
+};
+
+// Move ordering and network state of one search, so that several searches can run side by side without sharing it
+// Aligned to a cache line so that the tables of two searches never share one
+struct alignas(64) SearchThread {
+	SearchStack stack[MAX_PLY + 1];
+	int history[2][6][SQUARE_NUM];
+	Accumulator accumulators[MAX_PLY + 1];  // Network sums of the position at each ply while NNUE is in use
+	EvalTables evalTables;
+
+	void clear() {
+		for (auto& entry : stack) entry = { { 0, 0 } };
+		memset(history, 0, sizeof(history));
+	}
+};
+
+struct RootLine {
+	int score = -MATE_SCORE;
+	uint16_t pv[MAX_PLY] = {};
+};
+
 struct SearchInfo {
 	int depth = 0;
 	int seldepth = 0;
-	int nodes = 0;
-	int qnodes = 0;
+	uint64_t nodes = 0;
+	uint64_t qnodes = 0;
+	uint64_t totalNodes = 0;  // Nodes of all previous iterations
 	int score = 0;
 
-	double start = clock();
-	int limit = 0;
+	SearchLimits limits;
+	TimeManager tm;
 	bool abort = false;
+	std::atomic<bool> stop{ false };  // Set by the input thread on "stop" and "quit"
+	std::atomic<bool> pondering{ false };  // Time limits are ignored until "ponderhit"
 
 	uint16_t bestMove = 0;
 	uint16_t pv[MAX_PLY];
 
+	// The game history extended by the moves on the current line
+	KeyHistory history;
+
+	SearchThread thread;
+
+	// MultiPV: line k is searched with the first moves of lines 0 to k - 1 excluded at the root
+	int multiPV = 1;
+	int pvCount = 1;
+	int pvIndex = 0;
+	RootLine lines[maxMultiPV];
+
 	// ### DEBUG ###
 	bool debug = false;
 	int failHigh[3][FAIL_HIGH_MOVES];
 	int hashCount = 0;
 	int hashCut = 0;
-	int qHashHit = 0;
+	int evalCacheProbes = 0;
+	int evalCacheHits = 0;
+	int lazyEvals = 0;
 
 	void operator=(const SearchInfo& si) {
 		depth = si.depth;
 		seldepth = si.seldepth;
 		nodes = si.nodes;
 		qnodes = si.qnodes;
+		totalNodes = si.totalNodes;
 		score = si.score;
 
-		start = si.start;
-		limit = si.limit;
-		
 		bestMove = si.bestMove;
 		for (int i = 0; i < MAX_PLY; ++i) {
-			if (si.pv[i] == 0) break;
 			pv[i] = si.pv[i];
 		}
 
+		pvCount = si.pvCount;
+		for (int i = 0; i < pvCount; ++i) {
+			lines[i] = si.lines[i];
+		}
+
 		abort = si.abort;
 
 		// ### DEBUG ###
@@ -56,17 +124,26 @@ struct SearchInfo {
 		}
 		hashCount = si.hashCount;
 		hashCut = si.hashCut;
-		qHashHit = si.qHashHit;
+		evalCacheProbes = si.evalCacheProbes;
+		evalCacheHits = si.evalCacheHits;
+		lazyEvals = si.lazyEvals;
 	}
 
-	void initTime(int limitParam) {
-		start = clock();
-		limit = limitParam;
+	uint64_t searchedNodes() const {
+		return totalNodes + nodes + qnodes;
+	}
+
+	bool rootMoveAllowed(const uint16_t& m) const {
+		for (int i = 0; i < pvIndex; ++i) {
+			if (lines[i].pv[0] == m) return false;
+		}
+		return limits.searchMoves.empty() || std::find(limits.searchMoves.begin(), limits.searchMoves.end(), m) != limits.searchMoves.end();
 	}
 
 	void reset() {
 		depth = 0;
 		seldepth = 0;
+		totalNodes += nodes + qnodes;
 		nodes = 0;
 		qnodes = 0;
 		score = 0;
@@ -82,40 +159,62 @@ struct SearchInfo {
 		}
 		hashCount = 0;
 		hashCut = 0;
-		qHashHit = 0;
+		evalCacheProbes = 0;
+		evalCacheHits = 0;
+		lazyEvals = 0;
 	}
 
 	void print() {
-		std::cout << "info score ";
-		if (score > MATED_IN_MAX && score < MATE_IN_MAX) {
-			std::cout << "cp " << score;
-		}
-		else {
-			std::cout << "mate " << ((MATE_SCORE - abs(score)) / 2 + (score > 0)) * ((score > 0) ? 1 : -1);
-		}
-		std::cout << " depth " << depth << " seldepth " << seldepth << " nodes " << nodes + qnodes;
-		std::cout << " time " << (double)(clock() - start) / (CLOCKS_PER_SEC / 1000);
-		std::cout << " pv ";
-		for (const auto& m : pv) {
-			if (!m) break;
-			std::cout << toNotation(m) << " ";
+		OutputLine out;
+		for (int i = 0; i < pvCount; ++i) {
+			const int lineScore = lines[i].score;
+			out << "info ";
+			if (pvCount > 1) out << "multipv " << i + 1 << ' ';
+			out << "score ";
+			if (lineScore > MATED_IN_MAX && lineScore < MATE_IN_MAX) {
+				out << "cp " << lineScore;
+			}
+			else {
+				out << "mate " << ((MATE_SCORE - abs(lineScore)) / 2 + (lineScore > 0)) * ((lineScore > 0) ? 1 : -1);
+			}
+			out << " depth " << depth << " seldepth " << seldepth << " nodes " << searchedNodes();
+			out << " time " << tm.elapsed();
+			out << " pv";
+			for (const auto& m : lines[i].pv) {
+				if (!m) break;
+				out << ' ';
+				out.move(m);
+			}
+			out.send();
 		}
-		std::cout << "\n";
 	}
 
 	void printSearchDebug() {
-		std::cout << "\n+---+---+ ### NODES ### +---+---+\n\n";
+		OutputLine out;
+		out << "\n+---+---+ ### NODES ### +---+---+\n";
+		out.send();
+
+		float elapsed = std::max<int64_t>(tm.elapsed(), 1) / 1000.0f;
 
-		float elapsed = (double)(clock() - start) / (CLOCKS_PER_SEC);
+		out << "nodes: " << nodes << " | qnodes: " << qnodes;
+		out.send();
+		out << "nps: " << nodes / elapsed << " | qnps: " << qnodes / elapsed;
+		out.send();
 
-		std::cout << "nodes: " << nodes << " | qnodes: " << qnodes << "\n";
-		std::cout << "nps: " << nodes / elapsed << " | qnps: " << qnodes / elapsed << "\n";
+		out << "\n+---+---+ ### HASH ### +---+---+\n";
+		out.send();
 
-		std::cout << "\n+---+---+ ### HASH ### +---+---+\n\n";
+		out << "eval cache hit: " << (float)evalCacheHits / evalCacheProbes * 100 << '%';
+		out.send();
 
-		std::cout << "q-search eval hash hit: " << roundf((float)qHashHit / qnodes * 100 * 100) / 100 << "%\n";
+		out << "\n+---+---+ ### EVAL ### +---+---+\n";
+		out.send();
 
-		std::cout << "\n+---+---+ ### MOVE ORDERING ### +---+---+\n\n";
+		out << "lazy evaluations: " << (float)lazyEvals / (nodes + qnodes) * 100 << '%';
+		out.send();
+
+		out << "\n+---+---+ ### MOVE ORDERING ### +---+---+\n";
+		out.send();
 
 		int nearLeafTotal = 0;
 		int nearRootTotal = 0;
@@ -124,43 +223,36 @@ struct SearchInfo {
 		for (auto& i : failHigh[1]) nearRootTotal += i;
 		for (auto& i : failHigh[2]) qTotal += i;
 
-		std::cout << "fail-high percentages by move order\n";
-		std::cout << "near-leaf: ";
+		out << "fail-high percentages by move order";
+		out.send();
+		out << "near-leaf: ";
 		for (auto& i : failHigh[0]) {
-			std::cout << roundf((float)i / nearLeafTotal * 100 * 100) / 100 << "% | ";
+			out << (float)i / nearLeafTotal * 100 << "% | ";
 		}
-		std::cout << "\n";
+		out.send();
 
-		std::cout << "near-root: ";
+		out << "near-root: ";
 		for (auto& i : failHigh[1]) {
-			std::cout << roundf((float)i / nearRootTotal * 100 * 100) / 100 << "% | ";
+			out << (float)i / nearRootTotal * 100 << "% | ";
 		}
-		std::cout << "\n";
+		out.send();
 
-		std::cout << "q-search: ";
+		out << "q-search: ";
 		for (auto& i : failHigh[2]) {
-			std::cout << roundf((float)i / qTotal * 100 * 100) / 100 << "% | ";
+			out << (float)i / qTotal * 100 << "% | ";
 		}
-		std::cout << "\n";
+		out.send();
 
-		std::cout << "hash cut percentage : ";
-		std::cout << roundf((float)hashCut / hashCount * 100 * 100) / 100 << "%\n";
-		std::cout << "\n";
+		out << "hash cut percentage : " << (float)hashCut / hashCount * 100 << "%\n";
+		out.send();
 	}
 };
 
 static constexpr int aspirationMinDepth = 5;
 static constexpr int aspirationWindow = 35;
 
-static uint16_t killers[2][MAX_PLY + 1];
 static constexpr int killerBonus[4] = { -1, -2, -3, -4 };
 
-static constexpr int historyMultiplier = 32;
-static constexpr int historyDivisor = 512;
-static constexpr int historyMax = historyMultiplier * historyDivisor;
-static constexpr int historyMaxDepth = 8;
-static int historyMoves[2][6][SQUARE_NUM];
-
 static constexpr int nullMoveBaseR = 3;
 static constexpr int nullMoveMinDepth = 3;
 
@@ -198,18 +290,27 @@ static constexpr int SEEValues[5] = {
 	pieceValues[PAWN][MG], pieceValues[KNIGHT][MG], pieceValues[KNIGHT][MG], pieceValues[ROOK][MG], pieceValues[QUEEN][MG] 
 };
 
+// The entry points of one copy of the hot code, see KF_ISA
+struct SearchEntryPoints {
+	void (*iterativeDeepening)(Board& b, SearchInfo& si);
+	uint64_t (*perft)(Board& b, int depth, int ply);
+};
+
+inline namespace KF_ISA {
+
 void initSearch(SearchInfo& si);
 
-void timeOver(SearchInfo& si, const bool ignoreDepth, const bool ignoreNodeCount);
+void timeCheck(SearchInfo& si, const bool ignoreDepth, const bool ignoreNodeCount);
 
 void updateHistory(int& entry, int delta);
 
-int scoreMove(const Board& b, const uint16_t& m, int ply, int phase, const uint16_t& hashMove);
-std::vector<ScoredMove> scoreMoves(const Board& b, const std::vector<uint16_t>& moves, int ply, const uint16_t& hashMove);
+int scoreMove(const Board& b, const uint16_t& m, int ply, const uint16_t& hashMove, const SearchThread& thread);
+std::vector<ScoredMove> scoreMoves(const Board& b, const std::vector<uint16_t>& moves, int ply, const uint16_t& hashMove, const SearchThread& thread);
 
 int scoreNoisyMove(const Board& b, const uint16_t& m);
 std::vector<ScoredMove> scoreNoisyMoves(const Board& b, const std::vector<uint16_t>& moves);
 
+int staticEval(const Board& b, int alpha, int beta, bool& lazy, SearchInfo& si);
 int search(Board& b, int depth, int ply, int alpha, int beta, SearchInfo& si, uint16_t(&ppv)[MAX_PLY], bool allowNull);
 int qsearch(Board& b, int ply, int alpha, int beta, SearchInfo& si, uint16_t (&ppv)[MAX_PLY]);
 
@@ -217,6 +318,18 @@ int staticExchangeEvaluation(const Board& b, const uint16_t& m, int threshold =
 int SEEMoveVal(const Board& b, const uint16_t& m);
 int greatestTacticalGain(const Board& b);
 
-void iterativeDeepening(Board& b, SearchInfo& si, int timeLimit);
+uint16_t getPonderMove(Board& b, const SearchInfo& si);
+
+int countRootMoves(Board& b, const SearchInfo& si);
+void iterativeDeepening(Board& b, SearchInfo& si);
+
+extern const SearchEntryPoints isaEntryPoints;
+
+}
+
+// The copy compiled for this CPU, set by initEntryPoints once initCPU has run
+extern const SearchEntryPoints* entryPoints;
+
+void initEntryPoints();
 
 #endif
\ No newline at end of file
@@ -0,0 +1,72 @@
+#include "timeman.h"
+#include "types.h"
+
+void TimeManager::init(const TimeLimits& limits) {
+	start = Clock::now();
+	lastBestMove = 0;
+	lastScore = NO_VALUE;
+	stableIterations = 0;
+	ticks = 0;
+	checkInterval = minCheckInterval;
+	nextCheck = minCheckInterval;
+
+	// Fixed time per move
+	// The overhead takes at most a fraction of it, so that short fixed-time searches still search
+	if (limits.moveTime >= 0) {
+		timed = true;
+		hardLimit = std::max(limits.moveTime - std::min(moveOverhead, limits.moveTime / maxOverheadFraction), 1);
+		softLimit = optimum = hardLimit;
+		return;
+	}
+
+	// No clock given, search until told to stop or until another limit is hit
+	if (!limits.hasClock) {
+		timed = false;
+		softLimit = hardLimit = optimum = 0;
+		return;
+	}
+
+	// A flagged or nearly empty clock still gets a minimal budget, depth 1 always completes so we have a move
+	timed = true;
+	int64_t timeLeft = std::max(limits.timeLeft - moveOverhead, 1);
+	int movesToGo = (limits.movesToGo > 0) ? limits.movesToGo : defaultMovesToGo;
+
+	// The soft limit is our target time for this move, checked between iterations
+	// The hard limit aborts the search mid-iteration and leaves room for the moves still to come
+	optimum = timeLeft / (movesToGo + 3) + limits.increment * 3 / 4;
+	optimum = std::max<int64_t>(std::min<int64_t>(optimum, timeLeft * maxHardFraction / 2), 1);
+	hardLimit = std::min<int64_t>(optimum * hardLimitRatio, timeLeft * maxHardFraction);
+	hardLimit = std::max<int64_t>(hardLimit, 1);
+	softLimit = optimum;
+}
+
+void TimeManager::updateCheckInterval() {
+	// We aim for a clock read every 0.5 ms regardless of hardware speed, so stop latency stays below 1 ms
+	int64_t us = std::max<int64_t>(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count(), 1);
+	uint64_t nps = ticks * 1000000 / us;
+	checkInterval = std::min<uint64_t>(std::max<uint64_t>(nps / checkIntervalTarget, minCheckInterval), maxCheckInterval);
+	nextCheck = ticks + checkInterval;
+}
+
+void TimeManager::updateIteration(uint16_t bestMove, int score) {
+	if (!timed || optimum == hardLimit) {
+		lastBestMove = bestMove;
+		lastScore = score;
+		return;
+	}
+
+	// Step 1: Best move stability
+	// If the best move keeps changing we need more time, if it has been the same for a while we can move earlier
+	stableIterations = (bestMove == lastBestMove) ? stableIterations + 1 : 0;
+	double scale = (stableIterations == 0) ? 1.4 : std::max(1.0 - 0.1 * (stableIterations - 1), 0.6);
+
+	// Step 2: Score drops
+	// A falling score means we are probably running into trouble, so we spend extra time to find a way out
+	if (lastScore != NO_VALUE && lastScore - score > scoreDropMargin) {
+		scale *= 1.0 + (double)std::min(lastScore - score, scoreDropMax) / scoreDropMax;
+	}
+
+	softLimit = std::min<int64_t>(optimum * scale, hardLimit);
+	lastBestMove = bestMove;
+	lastScore = score;
+}
@@ -0,0 +1,82 @@
+#ifndef TIMEMAN_H
+#define TIMEMAN_H
+
+#include <chrono>
+
+#include "types.h"
+
+static constexpr int defaultMoveOverhead = 50;
+static constexpr int maxMoveOverhead = 5000;
+static constexpr int maxOverheadFraction = 4;  // With a fixed movetime the overhead takes at most 1/4 of it
+
+static constexpr int defaultMovesToGo = 30;
+static constexpr double hardLimitRatio = 2.0;  // The hard limit is at most this many times the soft limit
+static constexpr double maxHardFraction = 0.8;  // and never more than this fraction of the remaining time
+
+// An iteration takes about as long as all the previous ones together, so one started late in the soft limit
+// would run into the hard limit and its result would be thrown away
+static constexpr double iterationStartFraction = 0.55;
+
+static constexpr int scoreDropMargin = 20;
+static constexpr int scoreDropMax = 120;
+
+static constexpr int minCheckInterval = 64;
+static constexpr int maxCheckInterval = 16384;
+static constexpr int checkIntervalTarget = 2000;  // Time checks per second, i.e. every 0.5 ms
+
+struct TimeLimits {
+	bool hasClock = false;
+	int timeLeft = 0;
+	int increment = 0;
+	int movesToGo = -1;
+	int moveTime = -1;
+};
+
+struct TimeManager {
+	typedef std::chrono::steady_clock Clock;
+
+	Clock::time_point start = Clock::now();
+	bool timed = false;
+	int64_t softLimit = 0;
+	int64_t hardLimit = 0;
+	int64_t optimum = 0;
+	int moveOverhead = defaultMoveOverhead;
+
+	// Iteration history used to scale the soft limit
+	uint16_t lastBestMove = 0;
+	int lastScore = NO_VALUE;
+	int stableIterations = 0;
+
+	// Nodes between two clock reads, adapted to the measured speed
+	uint64_t ticks = 0;
+	uint64_t checkInterval = minCheckInterval;
+	uint64_t nextCheck = minCheckInterval;
+
+	void init(const TimeLimits& limits);
+
+	int64_t elapsed() const {
+		return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count();
+	}
+
+	bool hardExpired() const {
+		return timed && elapsed() >= hardLimit;
+	}
+
+	// With a fixed time per move we use all of it, otherwise we do not start an iteration we are unlikely to finish
+	bool canStartIteration() const {
+		if (!timed) return true;
+		return elapsed() < ((optimum == hardLimit) ? hardLimit : softLimit * iterationStartFraction);
+	}
+
+	// Called once per node, returns true when the clock should be read
+	bool tick() {
+		if (++ticks < nextCheck) return false;
+		updateCheckInterval();
+		return true;
+	}
+
+	void updateCheckInterval();
+	void updateIteration(uint16_t bestMove, int score);
+};
+
+#endif
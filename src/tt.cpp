@@ -1,13 +1,15 @@
+#include <memory>
+
 #include "board.h"
 #include "move.h"
 #include "search.h"
 #include "tt.h"
 #include "types.h"
 
-TTInfo tt[TTMaxEntry];
-PTTInfo ptt[TTMaxEntry];
-qHashInfo qhash[qHashMaxEntry];
-pHashInfo phash[pHashMaxEntry];
+TTInfo tt[TTMaxEntry + 4];
+PTTInfo ptt[TTMaxEntry + 1];
+static std::unique_ptr<EvalCacheEntry[]> evalCache;
+static uint64_t evalCacheMask = 0;
 
 int probeTT(const uint64_t& key, const int& depth, const int& alpha, const int& beta, const int& ply, SearchInfo& si, int& ttEval) {
 	
@@ -81,7 +83,7 @@ void storeTT(const uint64_t& key, const int& depth, const int& score, const int&
 		entry.depth = depth;
 		entry.score = score;
 		entry.flag = flag;
-		if (eval != NO_VALUE) entry.eval = eval;
+		entry.eval = eval;  // The old evaluation belongs to another position
 		entry.ply = ply;
 		entry.move = m;
 		entry.age = 0;
@@ -103,38 +105,49 @@ void storePTT(const uint64_t& key, int depth, int nodes) {
 	}
 }
 
-int probeQHash(const uint64_t& key) {
-	auto& entry = qhash[(uint32_t)key & qHashMaxEntry];
-	return (entry.key == (key >> 32)) ? entry.eval : NO_VALUE;
+void resizeEvalCache(int megabytes) {
+	// Round down to a power of two so that the index is a mask
+	size_t entries = 1;
+	while (entries * 2 * sizeof(EvalCacheEntry) <= ((size_t)megabytes << 20)) entries *= 2;
+	evalCache.reset(new EvalCacheEntry[entries]);
+	evalCacheMask = entries - 1;
 }
 
-void storeQHash(const uint64_t& key, const int& eval) {
-	auto& entry = qhash[(uint32_t)key & qHashMaxEntry];
-	// Always replace
-	entry.key = (key >> 32);
-	entry.eval = eval;
+void clearEvalCache() {
+	for (uint64_t i = 0; i <= evalCacheMask; ++i) {
+		evalCache[i].check.store(0, std::memory_order_relaxed);
+		evalCache[i].data.store(0, std::memory_order_relaxed);
+	}
 }
 
-int probePawnHash(const uint64_t& key, const int& color) {
-	auto& entry = phash[(uint32_t)key & pHashMaxEntry];
-	return (entry.key == (key >> 32) && entry.color == color) ? entry.staticEval : NO_VALUE;
+int probeEvalCache(const uint64_t& key) {
+	const auto& entry = evalCache[key & evalCacheMask];
+	const uint64_t data = entry.data.load(std::memory_order_relaxed);
+	const uint64_t check = entry.check.load(std::memory_order_relaxed);
+	return ((check ^ data) == key && (data & evalCacheValid)) ? (int)(int32_t)(uint32_t)data : NO_VALUE;
 }
 
-void storePawnHash(const uint64_t& key, const int& staticEval, const int& color) {
-	auto& entry = phash[(uint32_t)key & pHashMaxEntry];
+void storeEvalCache(const uint64_t& key, int eval) {
 	// Always replace
-	entry.key = (key >> 32);
-	entry.staticEval = staticEval;
-	entry.color = color;
+	auto& entry = evalCache[key & evalCacheMask];
+	const uint64_t data = evalCacheValid | (uint32_t)eval;
+	entry.check.store(key ^ data, std::memory_order_relaxed);
+	entry.data.store(data, std::memory_order_relaxed);
+}
+
+void clearTT() {
+	for (auto& entry : tt) entry = TTInfo();
+	for (auto& entry : ptt) entry = PTTInfo();
+	clearEvalCache();
 }
 
 void ageTT() {
-	for (int i = 0; i < TTMaxEntry; ++i) {
-		if (tt[i].key != 0 && tt[i].age < TTAgeLimit) {
-			tt[i].age++;
+	for (auto& entry : tt) {
+		if (entry.key != 0 && entry.age < TTAgeLimit) {
+			entry.age++;
 		}
 		else {
-			tt[i].key = 0;
+			entry.key = 0;
 		}
 	}
 }
\ No newline at end of file
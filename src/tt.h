@@ -28,28 +28,22 @@ struct PTTInfo {
 	uint64_t key = 0;
 };
 
-struct qHashInfo {
-	qHashInfo() {};
-	int eval = NO_VALUE;
-	uint64_t key = 0;
+// Static evaluations from the side to move's point of view, verified with the full key
+// The key is stored xor the data, so an entry torn by a concurrent write fails verification instead of returning a wrong score
+struct EvalCacheEntry {
+	std::atomic<uint64_t> check{ 0 };
+	std::atomic<uint64_t> data{ 0 };
 };
 
-struct pHashInfo {
-	pHashInfo() {};
-	int staticEval = NO_VALUE;
-	int color = NO_COLOR;
-	uint64_t key = 0;
-};
+static constexpr uint64_t evalCacheValid = 1ull << 32;  // Set in the data of every stored entry, so empty entries never match
+static constexpr int defaultEvalCacheSize = 16;  // MB
+static constexpr int maxEvalCacheSize = 1024;
 
+// Used as an index mask, so the last bucket starts at TTMaxEntry and the table needs room for its four entries
 static constexpr int TTMaxEntry = 0xfffff;
 static constexpr int TTAgeLimit = 6;
-extern TTInfo tt[TTMaxEntry];
+extern TTInfo tt[TTMaxEntry + 4];
 
-static constexpr int qHashMaxEntry = 0xfffff;
-extern qHashInfo qhash[qHashMaxEntry];
-
-static constexpr int pHashMaxEntry = 0xfff;
-extern pHashInfo phash[pHashMaxEntry];
 
 int probeTT(const uint64_t& key, const int& depth, const int& alpha, const int& beta, const int& ply, SearchInfo& si, int& ttEval);
 uint16_t probeHashMove(const uint64_t& key);
@@ -58,12 +52,12 @@ void storeTT(const uint64_t& key, const int& depth, const int& score, const int&
 int probePTT(const uint64_t& key, int depth);
 void storePTT(const uint64_t& key, int depth, int nodes);
 
-int probeQHash(const uint64_t& key);
-void storeQHash(const uint64_t& key, const int& eval);
-
-int probePawnHash(const uint64_t& key, const int& color);
-void storePawnHash(const uint64_t& key, const int& staticEval, const int& color);
+void resizeEvalCache(int megabytes);
+void clearEvalCache();
+int probeEvalCache(const uint64_t& key);
+void storeEvalCache(const uint64_t& key, int eval);
 
 void ageTT();
+void clearTT();
 
 #endif
\ No newline at end of file
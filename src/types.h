@@ -6,11 +6,17 @@
 #include <time.h>
 
 #include <algorithm>
+#include <atomic>
+#include <charconv>
 #include <cmath>
 #include <climits>
 #include <iostream>
+#include <mutex>
 #include <random>
 #include <cstring>
+#include <string>
+#include <string_view>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
@@ -67,6 +73,22 @@ enum Castling { WK_CASTLING = 1, WQ_CASTLING = 2, BK_CASTLING = 4, BQ_CASTLING =
 
 enum Phase { MG, EG };
 
+// A middlegame and an endgame score in one int, so that both are added, subtracted and multiplied at once
+// The endgame score sits in the upper half, a negative middlegame score borrows one from it
+typedef int32_t PackedScore;
+
+static constexpr PackedScore makeScore(int mg, int eg) {
+	return (PackedScore)((uint32_t)eg << 16) + mg;
+}
+
+static constexpr int mgScore(PackedScore s) {
+	return (int16_t)(uint16_t)(uint32_t)s;
+}
+
+static constexpr int egScore(PackedScore s) {
+	return (int16_t)(uint16_t)((uint32_t)(s + 0x8000) >> 16);
+}
+
 enum Search {
 	MAX_PLY = 64,
 };
@@ -83,7 +105,10 @@ enum Score {
 typedef struct Board Board;
 typedef struct Undo Undo;
 typedef struct SearchInfo SearchInfo;
+typedef struct SearchThread SearchThread;
 typedef struct TTInfo TTInfo;
+typedef struct PawnEntry PawnEntry;
+typedef struct Accumulator Accumulator;
 
 // Helper functions
 static inline int toSquare(int r, int c) {
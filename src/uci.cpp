@@ -4,82 +4,199 @@
 #include "evaluate.h"
 #include "move.h"
 #include "movegen.h"
+#include "nnue.h"
+#include "pawns.h"
 #include "search.h"
+#include "tt.h"
 #include "types.h"
 #include "uci.h"
 
-static constexpr int TIME_BUFFER = 200;
+// The position of the previous "position" command, so a growing game only needs its new moves applied
+struct PositionCache {
+	bool valid = false;
+	std::string base;
+	std::string moves;
+};
 
-void parsePosition(Board& b, std::string input) {
-	// Erase "position "
-	input.erase(0, 9);
+static PositionCache positionCache;
 
-	if (!input.compare(0, 8, "startpos")) {
-		parseFen(b, "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+UciCommand parseCommand(std::string_view token) {
+	for (const auto& entry : uciCommands) {
+		if (entry.name == token) return entry.command;
+	}
+	return CMD_UNKNOWN;
+}
+
+void parsePosition(Board& b, KeyHistory& history, std::string_view input) {
+	Tokenizer tokens(input);
+	tokens.next();  // "position"
+
+	// The base position is everything up to "moves"
+	size_t baseStart = tokens.pos;
+	size_t baseEnd = tokens.pos;
+	std::string_view token;
+	while (!(token = tokens.next()).empty() && token != "moves") baseEnd = tokens.pos;
+	std::string_view base = Tokenizer(input.substr(baseStart, baseEnd - baseStart)).rest();
+	std::string_view moves = tokens.rest();
+
+	// If the base position is the same and the new move list extends the old one, we only play the new moves
+	size_t applied = 0;
+	bool extends = positionCache.valid && base == positionCache.base &&
+				   moves.size() >= positionCache.moves.size() &&
+				   moves.compare(0, positionCache.moves.size(), positionCache.moves) == 0 &&
+				   (moves.size() == positionCache.moves.size() || positionCache.moves.empty() || moves[positionCache.moves.size()] == ' ');
+
+	if (extends) {
+		applied = positionCache.moves.size();
 	}
 	else {
-		input.erase(0, 4);  // Erase "fen "
-		parseFen(b, input);
+		// An invalid FEN leaves the current position untouched
+		Tokenizer baseTokens(base);
+		Board parsed;
+		bool valid = (baseTokens.next() == "fen") ? parseFen(parsed, baseTokens.rest()) : parseFen(parsed, startFen);
+		if (!valid) {
+			std::cout << "info string Invalid FEN: " << baseTokens.rest() << "\n";
+			positionCache.valid = false;
+			return;
+		}
+		b = parsed;
+		history.reset(b.key);
 	}
 
-	size_t pos = input.find("moves");
-	if (pos == std::string::npos) return;
-	input.erase(0, pos + 6);  // Erase "moves "
-	// Failsafe if last character is not newline
-	if (input.back() != '\n') {
-		input.insert(input.end(), '\n');
+	Tokenizer moveTokens(moves.substr(applied));
+	while (!(token = moveTokens.next()).empty()) {
+		if (token.size() < 4) continue;
+		makeMove(b, toMove(b, token));
+		history.push(b.key);
 	}
-	input.insert(input.end() - 1, ' ');  // Insert space after the last move so it can be parsed
 
-	while ((pos = input.find(' ')) != std::string::npos) {
-		makeMove(b, toMove(b, input.substr(0, pos)));
-		input.erase(0, pos + 1);
-	}
+	positionCache.valid = true;
+	positionCache.base.assign(base);
+	positionCache.moves.assign(moves);
 }
-void parseGo(Board& b, SearchInfo& si, std::string input) {
-	int depth = 0, moveTime = -1, time = 0;
-	int movesToGo = -1;
-	int increment = 0, timeLeft = 0;
-
-	size_t pos;
-	if ((pos = input.find("winc")) != std::string::npos && b.turn == WHITE) {
-		increment = std::stoi(input.substr(pos + 5));
-	}
-	if ((pos = input.find("binc")) != std::string::npos && b.turn == BLACK) {
-		increment = std::stoi(input.substr(pos + 5));
-	}
-	if ((pos = input.find("wtime")) != std::string::npos && b.turn == WHITE) {
-		timeLeft = std::stoi(input.substr(pos + 6));
+
+static bool isMoveToken(std::string_view token) {
+	return (token.size() == 4 || token.size() == 5) &&
+		   token[0] >= 'a' && token[0] <= 'h' && token[1] >= '1' && token[1] <= '8' &&
+		   token[2] >= 'a' && token[2] <= 'h' && token[3] >= '1' && token[3] <= '8';
+}
+
+void parseSearchMoves(Board& b, SearchInfo& si, Tokenizer& tokens) {
+	// Moves run until the next go parameter, we only keep the legal ones
+	while (isMoveToken(tokens.peek())) {
+		uint16_t m = toMove(b, tokens.next());
+		if (!moveIsPsuedoLegal(b, m)) continue;
+		auto u = makeMove(b, m);
+		bool legal = !inCheck(b, !b.turn);
+		undoMove(b, m, u);
+		if (legal) si.limits.searchMoves.push_back(m);
 	}
-	if ((pos = input.find("btime")) != std::string::npos && b.turn == BLACK) {
-		timeLeft = std::stoi(input.substr(pos + 6));
+}
+
+void parseGo(Board& b, SearchInfo& si, std::string_view input) {
+	TimeLimits limits;
+	si.limits.clear();
+	si.pondering = false;
+
+	Tokenizer tokens(input);
+	tokens.next();  // "go"
+
+	// Parameters with malformed values are ignored and keep their defaults
+	std::string_view token;
+	while (!(token = tokens.next()).empty()) {
+		if (token == "wtime" || token == "btime") {
+			int value;
+			// Some GUIs send a negative time once the flag has fallen, we still have to reply with a move
+			if (parseNumber(tokens.next(), value) && (token[0] == 'w') == (b.turn == WHITE)) {
+				limits.hasClock = true;
+				limits.timeLeft = std::max(value, 0);
+			}
+		}
+		else if (token == "winc" || token == "binc") {
+			int value;
+			if (parseNumber(tokens.next(), value) && (token[0] == 'w') == (b.turn == WHITE)) limits.increment = std::max(value, 0);
+		}
+		else if (token == "movestogo") {
+			parseNumber(tokens.next(), limits.movesToGo);
+		}
+		else if (token == "movetime") {
+			int value;
+			if (parseNumber(tokens.next(), value)) limits.moveTime = std::max(value, 0);
+		}
+		else if (token == "depth") {
+			int value;
+			if (parseNumber(tokens.next(), value)) si.limits.depth = std::min(std::max(value, 1), (int)MAX_PLY);
+		}
+		else if (token == "nodes") {
+			parseNumber(tokens.next(), si.limits.nodes);
+		}
+		else if (token == "mate") {
+			int value;
+			if (parseNumber(tokens.next(), value)) si.limits.mate = std::max(value, 1);
+		}
+		else if (token == "infinite") {
+			si.limits.infinite = true;
+		}
+		else if (token == "ponder") {
+			// "go ponder" searches the expected reply to our last move until the GUI sends "ponderhit" or "stop"
+			si.pondering = true;
+		}
+		else if (token == "searchmoves") {
+			parseSearchMoves(b, si, tokens);
+		}
 	}
-	if ((pos = input.find("depth")) != std::string::npos) {
-		depth = std::stoi(input.substr(pos + 6));
+
+	si.tm.init(limits);
+}
+
+void parseOption(SearchInfo& si, std::string_view input) {
+	// setoption name <id> [value <x>]
+	// Option names may contain spaces, so the name runs until the "value" token
+	Tokenizer tokens(input);
+	tokens.next();  // "setoption"
+	if (tokens.next() != "name") return;
+
+	size_t nameStart = tokens.pos;
+	size_t nameEnd = tokens.pos;
+	std::string_view token;
+	while (!(token = tokens.next()).empty() && token != "value") nameEnd = tokens.pos;
+	std::string_view name = Tokenizer(input.substr(nameStart, nameEnd - nameStart)).rest();
+	std::string_view value = tokens.rest();
+
+	int number;
+	if (name == "MultiPV" && parseNumber(value, number)) {
+		si.multiPV = std::min(std::max(number, 1), maxMultiPV);
 	}
-	if ((pos = input.find("movestogo")) != std::string::npos) {
-		movesToGo = std::stoi(input.substr(pos + 10));
+	if (name == "Move Overhead" && parseNumber(value, number)) {
+		si.tm.moveOverhead = std::min(std::max(number, 0), maxMoveOverhead);
 	}
-	if ((pos = input.find("movetime")) != std::string::npos) {
-		moveTime = std::stoi(input.substr(pos + 9));
+	if (name == "Pawn Hash" && parseNumber(value, number)) {
+		resizePawnHash(si.thread.evalTables.pawns, std::min(std::max(number, 1), maxPawnHashSize));
 	}
-
-	if (movesToGo >= 0) {
-		time = 0.9 * (timeLeft / (movesToGo + 3)) + increment - TIME_BUFFER;
-	} else {
-		time = (timeLeft + 20 * increment) / 30 - TIME_BUFFER;
+	if (name == "Eval Cache" && parseNumber(value, number)) {
+		resizeEvalCache(std::min(std::max(number, 1), maxEvalCacheSize));
 	}
-
-	if (moveTime >= 0) {
-		time = moveTime - TIME_BUFFER * 3;
-		timeLeft = time;
+	// Cached and stored evaluations come from the evaluation that was in use at the time
+	if (name == "EvalFile" && !value.empty()) {
+		evalFile = std::string(value);
+		if (useNNUE) setNNUE(true);
+		clearTT();
 	}
-
-	if (!depth) {
-		depth = MAX_PLY;
+	if (name == "Use NNUE") {
+		setNNUE(value == "true");
+		clearTT();
 	}
+}
 
-	time = std::min(timeLeft, time);
-
-	iterativeDeepening(b, si, time);
+void printUCI() {
+	std::cout << "id name Kingfisher\n";
+	std::cout << "id author Eric Yip\n";
+	std::cout << "option name Ponder type check default false\n";
+	std::cout << "option name MultiPV type spin default 1 min 1 max " << maxMultiPV << "\n";
+	std::cout << "option name Move Overhead type spin default " << defaultMoveOverhead << " min 0 max " << maxMoveOverhead << "\n";
+	std::cout << "option name Pawn Hash type spin default " << defaultPawnHashSize << " min 1 max " << maxPawnHashSize << "\n";
+	std::cout << "option name Eval Cache type spin default " << defaultEvalCacheSize << " min 1 max " << maxEvalCacheSize << "\n";
+	std::cout << "option name Use NNUE type check default false\n";
+	std::cout << "option name EvalFile type string default " << defaultEvalFile << "\n";
+	std::cout << "uciok\n";
 }
\ No newline at end of file
@@ -3,7 +3,75 @@
 
 #include "types.h"
 
-void parsePosition(Board& b, std::string input);
-void parseGo(Board& b, SearchInfo& si, std::string input);
+enum UciCommand {
+	CMD_UCI, CMD_ISREADY, CMD_UCINEWGAME, CMD_POSITION, CMD_GO, CMD_STOP, CMD_PONDERHIT, CMD_SETOPTION, CMD_QUIT,
+	CMD_PERFT, CMD_PRINT, CMD_DEBUG, CMD_FENBENCH, CMD_LATENCYBENCH, CMD_BENCH, CMD_TIMEBENCH, CMD_PAWNBENCH, CMD_UNKNOWN
+};
 
-#endif
\ No newline at end of file
+struct UciCommandEntry {
+	std::string_view name;
+	UciCommand command;
+};
+
+static constexpr UciCommandEntry uciCommands[] = {
+	{ "uci", CMD_UCI }, { "isready", CMD_ISREADY }, { "ucinewgame", CMD_UCINEWGAME }, { "position", CMD_POSITION },
+	{ "go", CMD_GO }, { "stop", CMD_STOP }, { "ponderhit", CMD_PONDERHIT }, { "setoption", CMD_SETOPTION },
+	{ "quit", CMD_QUIT }, { "perft", CMD_PERFT }, { "print", CMD_PRINT }, { "debug", CMD_DEBUG }, { "fenbench", CMD_FENBENCH },
+	{ "latencybench", CMD_LATENCYBENCH }, { "bench", CMD_BENCH }, { "timebench", CMD_TIMEBENCH },
+	{ "pawnbench", CMD_PAWNBENCH }
+};
+
+// Splits a line into whitespace-separated tokens without copying
+struct Tokenizer {
+	std::string_view line;
+	size_t pos = 0;
+
+	Tokenizer(std::string_view lineParam) : line(lineParam) {}
+
+	std::string_view next() {
+		while (pos < line.size() && isspace((unsigned char)line[pos])) pos++;
+		size_t start = pos;
+		while (pos < line.size() && !isspace((unsigned char)line[pos])) pos++;
+		return line.substr(start, pos - start);
+	}
+
+	std::string_view peek() const {
+		Tokenizer copy = *this;
+		return copy.next();
+	}
+
+	// Everything that has not been consumed yet, without surrounding whitespace
+	std::string_view rest() const {
+		size_t start = pos;
+		size_t end = line.size();
+		while (start < end && isspace((unsigned char)line[start])) start++;
+		while (end > start && isspace((unsigned char)line[end - 1])) end--;
+		return line.substr(start, end - start);
+	}
+
+	bool empty() const {
+		return rest().empty();
+	}
+};
+
+// Parses a whole token as a decimal number, returns false instead of throwing on malformed input
+template <typename T>
+static inline bool parseNumber(std::string_view token, T& value) {
+	if (!token.empty() && token[0] == '+') token.remove_prefix(1);
+	T result;
+	auto [end, ec] = std::from_chars(token.data(), token.data() + token.size(), result);
+	if (ec != std::errc() || end != token.data() + token.size() || token.empty()) return false;
+	value = result;
+	return true;
+}
+
+UciCommand parseCommand(std::string_view token);
+
+void parsePosition(Board& b, KeyHistory& history, std::string_view input);
+void parseSearchMoves(Board& b, SearchInfo& si, Tokenizer& tokens);
+void parseGo(Board& b, SearchInfo& si, std::string_view input);
+void parseOption(SearchInfo& si, std::string_view input);
+
+void printUCI();
+
+#endif